@@ -0,0 +1,432 @@
+#include "ghash.h"
+#include "sm4_simd.h"
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+#include <array>
+#include <immintrin.h>
+
+//-------------λʵ--------------
+
+// Galois˷ GF(2^128)
+void galois_mult(const uint8_t* X, const uint8_t* Y, uint8_t* result) {
+    uint8_t Z[16] = { 0 };
+    uint8_t V[16];
+    memcpy(V, Y, 16);
+
+    for (int i = 0; i < 128; i++) {
+        int byteIndex = i / 8;
+        int bitIndex = 7 - (i % 8);
+        if ((X[byteIndex] >> bitIndex) & 1) {
+            for (int j = 0; j < 16; j++) {
+                Z[j] ^= V[j];
+            }
+        }
+
+        bool lsb = V[15] & 1;
+        for (int j = 15; j > 0; j--) {
+            V[j] = (V[j] >> 1) | ((V[j - 1] & 1) << 7);
+        }
+        V[0] >>= 1;
+        if (lsb) V[0] ^= 0xe1;
+    }
+    memcpy(result, Z, 16);
+}
+
+static void ghash_bitwise(const uint8_t* H, uint8_t* X, const uint8_t* data, size_t blocks) {
+    for (size_t i = 0; i < blocks; i++) {
+        for (int j = 0; j < 16; j++) {
+            X[j] ^= data[i * 16 + j];
+        }
+        galois_mult(X, H, X);
+    }
+}
+
+//-------------Shoup ʵ--------------
+//
+// Դ˵ 64 λ (hi, lo) ʾԪأ x һλ
+// Ƴλ 0xe1 << 120 ԼԤȼ H  4 λ 8 λʽĳ˻
+// ÿΰ Z  x^4 x^8һƳλ rem һԹԼ
+
+static inline uint64_t load_be64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void store_be64(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+// V = V * x
+static constexpr void mulX(uint64_t& hi, uint64_t& lo) {
+    uint64_t r = 0xe100000000000000ull & (0 - (lo & 1));
+    lo = (hi << 63) | (lo >> 1);
+    hi = (hi >> 1) ^ r;
+}
+
+// rem[b] BITS λΪ b Ԫ BITS λʱҪ򵽸λĹԼֵ
+template <int BITS>
+static constexpr std::array<uint64_t, (1 << BITS)> makeRem() {
+    std::array<uint64_t, (1 << BITS)> rem = {};
+    for (int b = 0; b < (1 << BITS); b++) {
+        uint64_t hi = 0, lo = static_cast<uint64_t>(b);
+        for (int i = 0; i < BITS; i++) {
+            mulX(hi, lo);
+        }
+        rem[b] = hi;
+    }
+    return rem;
+}
+
+static constexpr std::array<uint64_t, 16> kRem4 = makeRem<4>();
+static constexpr std::array<uint64_t, 256> kRem8 = makeRem<8>();
+
+// table[i] = i * Hi λӦ x^0
+static void buildTable(const uint8_t* H, int bits, uint64_t* table) {
+    int n = 1 << bits;
+    uint64_t hi = load_be64(H), lo = load_be64(H + 8);
+    table[0] = table[1] = 0;
+    for (int i = n / 2; i > 0; i /= 2) {
+        table[2 * i] = hi;
+        table[2 * i + 1] = lo;
+        mulX(hi, lo);
+    }
+    for (int i = 2; i < n; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            table[2 * (i + j)] = table[2 * i] ^ table[2 * j];
+            table[2 * (i + j) + 1] = table[2 * i + 1] ^ table[2 * j + 1];
+        }
+    }
+}
+
+static void ghash_table4(const uint64_t* table, uint8_t* X, const uint8_t* data, size_t blocks) {
+    uint64_t xh = load_be64(X), xl = load_be64(X + 8);
+    for (size_t k = 0; k < blocks; k++, data += 16) {
+        uint8_t x[16];
+        store_be64(x, xh ^ load_be64(data));
+        store_be64(x + 8, xl ^ load_be64(data + 8));
+
+        // һֽǰÿֽȵͰֽںֽ߰
+        uint64_t zh = 0, zl = 0;
+        for (int i = 15; i >= 0; i--) {
+            int nibbles[2] = { x[i] & 0xf, x[i] >> 4 };
+            for (int n : nibbles) {
+                uint64_t rem = zl & 0xf;
+                zl = (zh << 60) | (zl >> 4);
+                zh = (zh >> 4) ^ kRem4[rem];
+                zh ^= table[2 * n];
+                zl ^= table[2 * n + 1];
+            }
+        }
+        xh = zh;
+        xl = zl;
+    }
+    store_be64(X, xh);
+    store_be64(X + 8, xl);
+}
+
+static void ghash_table8(const uint64_t* table, uint8_t* X, const uint8_t* data, size_t blocks) {
+    uint64_t xh = load_be64(X), xl = load_be64(X + 8);
+    for (size_t k = 0; k < blocks; k++, data += 16) {
+        uint8_t x[16];
+        store_be64(x, xh ^ load_be64(data));
+        store_be64(x + 8, xl ^ load_be64(data + 8));
+
+        uint64_t zh = 0, zl = 0;
+        for (int i = 15; i >= 0; i--) {
+            uint64_t rem = zl & 0xff;
+            zl = (zh << 56) | (zl >> 8);
+            zh = (zh >> 8) ^ kRem8[rem];
+            zh ^= table[2 * x[i]];
+            zl ^= table[2 * x[i] + 1];
+        }
+        xh = zh;
+        xl = zl;
+    }
+    store_be64(X, xh);
+    store_be64(X + 8, xl);
+}
+
+//-------------PCLMULQDQ--------------
+//
+// 鰴ֽGCM ıΪ""ʽ
+// 128x128 λ޽λ˻һλΪеĳ˻ٰ x^128 + x^7 + x^2 + x + 1 Լ
+// ˷ Karatsuba  3  64x64 ˷8 δԼ˻ۼӣֻԼһΣ
+//     X' = (X ^ C1) * H^8 ^ C2 * H^7 ^ ... ^ C8 * H
+
+SM4_TARGET("ssse3")
+static inline __m128i bswap128(__m128i x) {
+    const __m128i mask = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    return _mm_shuffle_epi8(x, mask);
+}
+
+// 256 λ˻ hi:lo һλԼΪ 128 λ
+SM4_TARGET("sse2")
+static inline __m128i reduce(__m128i lo, __m128i hi) {
+    // һλ
+    __m128i lc = _mm_srli_epi32(lo, 31);
+    __m128i hc = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    hi = _mm_or_si128(hi, _mm_srli_si128(lc, 12));
+    hc = _mm_slli_si128(hc, 4);
+    lc = _mm_slli_si128(lc, 4);
+    lo = _mm_or_si128(lo, lc);
+    hi = _mm_or_si128(hi, hc);
+
+    // һȥ 64 λ
+    __m128i a = _mm_slli_epi32(lo, 31);
+    __m128i b = _mm_slli_epi32(lo, 30);
+    __m128i c = _mm_slli_epi32(lo, 25);
+    a = _mm_xor_si128(_mm_xor_si128(a, b), c);
+    b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    lo = _mm_xor_si128(lo, a);
+
+    // ڶ۵ 128 λ
+    __m128i d = _mm_srli_epi32(lo, 1);
+    __m128i e = _mm_srli_epi32(lo, 2);
+    __m128i f = _mm_srli_epi32(lo, 7);
+    d = _mm_xor_si128(_mm_xor_si128(d, e), _mm_xor_si128(f, b));
+    lo = _mm_xor_si128(lo, d);
+    return _mm_xor_si128(hi, lo);
+}
+
+//  Karatsuba õ 256 λ˻Լ
+SM4_TARGET("sse2")
+static inline __m128i reduceKaratsuba(__m128i lo, __m128i mid, __m128i hi) {
+    mid = _mm_xor_si128(mid, _mm_xor_si128(lo, hi));
+    lo = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    hi = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+    return reduce(lo, hi);
+}
+
+// һγ˷ۼӣlo/mid/hi += a * hδԼk Ϊ h ߵ 64 λ
+#define GHASH_MUL_ACC_CLMUL(a, h, k, lo, mid, hi)                                           \
+    do {                                                                                    \
+        __m128i aa = _mm_xor_si128(a, _mm_shuffle_epi32(a, 0x4e));                         \
+        lo = _mm_xor_si128(lo, _mm_clmulepi64_si128(a, h, 0x00));                          \
+        hi = _mm_xor_si128(hi, _mm_clmulepi64_si128(a, h, 0x11));                          \
+        mid = _mm_xor_si128(mid, _mm_clmulepi64_si128(aa, k, 0x00));                       \
+    } while (0)
+
+SM4_TARGET("pclmul,ssse3")
+static void ghash_clmul(const uint8_t (*powers)[16], const uint8_t (*karatsuba)[16],
+    uint8_t* X, const uint8_t* data, size_t blocks) {
+    __m128i x = bswap128(_mm_loadu_si128((const __m128i*)X));
+
+    while (blocks > 0) {
+        //  8 ʱʹýϵ͵ݴ H^n..H^1
+        size_t n = std::min<size_t>(blocks, GHashKey::kPowers);
+        size_t first = GHashKey::kPowers - n;
+        __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+        for (size_t i = 0; i < n; i++) {
+            __m128i c = bswap128(_mm_loadu_si128((const __m128i*)(data + i * 16)));
+            if (i == 0) c = _mm_xor_si128(c, x);
+            __m128i h = _mm_load_si128((const __m128i*)powers[first + i]);
+            __m128i k = _mm_load_si128((const __m128i*)karatsuba[first + i]);
+            GHASH_MUL_ACC_CLMUL(c, h, k, lo, mid, hi);
+        }
+        x = reduceKaratsuba(lo, mid, hi);
+        data += n * 16;
+        blocks -= n;
+    }
+
+    _mm_storeu_si128((__m128i*)X, bswap128(x));
+}
+
+//  H^1..H^8ֽʽ CLMUL ˣpowers ݴδӸߵʹ
+SM4_TARGET("pclmul,ssse3")
+static void clmul_powers(const uint8_t* H, uint8_t (*powers)[16], uint8_t (*karatsuba)[16]) {
+    __m128i h = bswap128(_mm_loadu_si128((const __m128i*)H));
+    __m128i hk = _mm_xor_si128(h, _mm_shuffle_epi32(h, 0x4e));
+    __m128i p = h;
+    for (int i = GHashKey::kPowers - 1; i >= 0; i--) {
+        _mm_store_si128((__m128i*)powers[i], p);
+        _mm_store_si128((__m128i*)karatsuba[i], _mm_xor_si128(p, _mm_shuffle_epi32(p, 0x4e)));
+        __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+        GHASH_MUL_ACC_CLMUL(p, h, hk, lo, mid, hi);
+        p = reduceKaratsuba(lo, mid, hi);
+    }
+}
+
+// X = X * Y
+SM4_TARGET("pclmul,ssse3")
+static void clmul_multiply(uint8_t* X, const uint8_t* Y) {
+    __m128i x = bswap128(_mm_loadu_si128((const __m128i*)X));
+    __m128i y = bswap128(_mm_loadu_si128((const __m128i*)Y));
+    __m128i k = _mm_xor_si128(y, _mm_shuffle_epi32(y, 0x4e));
+    __m128i lo = _mm_setzero_si128(), mid = lo, hi = lo;
+    GHASH_MUL_ACC_CLMUL(x, y, k, lo, mid, hi);
+    _mm_storeu_si128((__m128i*)X, bswap128(reduceKaratsuba(lo, mid, hi)));
+}
+
+//-------------VPCLMULQDQ + AVX-512--------------
+//
+// һ zmm Ĵ 4 飬8 ֱ H^8..H^5  H^4..H^1
+// Ĵĳ˻ۼӺ 4  128 λͨһһιԼ
+
+SM4_TARGET("avx512f,avx512bw")
+static inline __m512i bswap128_avx512(__m512i x) {
+    const __m512i mask = _mm512_set4_epi32(0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f);
+    return _mm512_shuffle_epi8(x, mask);
+}
+
+SM4_TARGET("avx512f")
+static inline __m128i fold512(__m512i x) {
+    __m256i y = _mm256_xor_si256(_mm512_castsi512_si256(x), _mm512_extracti64x4_epi64(x, 1));
+    return _mm_xor_si128(_mm256_castsi256_si128(y), _mm256_extracti128_si256(y, 1));
+}
+
+#define GHASH_MUL_ACC_VPCLMUL(a, h, k, lo, mid, hi)                                         \
+    do {                                                                                    \
+        __m512i aa = _mm512_xor_si512(a, _mm512_shuffle_epi32(a, (_MM_PERM_ENUM)0x4e));     \
+        lo = _mm512_xor_si512(lo, _mm512_clmulepi64_epi128(a, h, 0x00));                   \
+        hi = _mm512_xor_si512(hi, _mm512_clmulepi64_epi128(a, h, 0x11));                   \
+        mid = _mm512_xor_si512(mid, _mm512_clmulepi64_epi128(aa, k, 0x00));                \
+    } while (0)
+
+SM4_TARGET("avx512f,avx512bw,vpclmulqdq,pclmul,ssse3")
+static void ghash_vpclmul(const uint8_t (*powers)[16], const uint8_t (*karatsuba)[16],
+    uint8_t* X, const uint8_t* data, size_t blocks) {
+    if (blocks >= 8) {
+        const __m512i h0 = _mm512_load_si512((const void*)powers[0]);
+        const __m512i h1 = _mm512_load_si512((const void*)powers[4]);
+        const __m512i k0 = _mm512_load_si512((const void*)karatsuba[0]);
+        const __m512i k1 = _mm512_load_si512((const void*)karatsuba[4]);
+        __m128i x = bswap128(_mm_loadu_si128((const __m128i*)X));
+
+        for (; blocks >= 8; blocks -= 8, data += 128) {
+            __m512i c0 = bswap128_avx512(_mm512_loadu_si512((const void*)data));
+            __m512i c1 = bswap128_avx512(_mm512_loadu_si512((const void*)(data + 64)));
+            c0 = _mm512_xor_si512(c0, _mm512_zextsi128_si512(x));
+            __m512i lo = _mm512_setzero_si512(), mid = lo, hi = lo;
+            GHASH_MUL_ACC_VPCLMUL(c0, h0, k0, lo, mid, hi);
+            GHASH_MUL_ACC_VPCLMUL(c1, h1, k1, lo, mid, hi);
+            x = reduceKaratsuba(fold512(lo), fold512(mid), fold512(hi));
+        }
+
+        _mm_storeu_si128((__m128i*)X, bswap128(x));
+    }
+    if (blocks > 0) {
+        ghash_clmul(powers, karatsuba, X, data, blocks);
+    }
+}
+
+//-------------GHashKey--------------
+
+static bool supported(GHashKey::Backend backend) {
+    const sm4simd::CpuFeatures& f = sm4simd::cpuFeatures();
+    switch (backend) {
+    case GHashKey::BITWISE:
+    case GHashKey::TABLE4:
+    case GHashKey::TABLE8:  return true;
+    case GHashKey::CLMUL:   return f.pclmul;
+    case GHashKey::VPCLMUL: return f.pclmul && f.vpclmul && f.avx512;
+    default:                return false;
+    }
+}
+
+GHashKey::GHashKey() : backend(BITWISE) {
+    memset(H, 0, 16);
+    memset(powers, 0, sizeof(powers));
+    memset(karatsuba, 0, sizeof(karatsuba));
+}
+
+GHashKey::GHashKey(const uint8_t* H, Backend backend) {
+    if (backend == AUTO) {
+        // û޽λ˷ʱʹ 4 λСʺÿԿһ
+        static const Backend order[] = { VPCLMUL, CLMUL, TABLE4 };
+        for (Backend b : order) {
+            if (supported(b)) {
+                backend = b;
+                break;
+            }
+        }
+    }
+    else if (backend < BITWISE || backend > VPCLMUL) {
+        throw std::invalid_argument("Invalid backend");
+    }
+    else if (!supported(backend)) {
+        throw std::runtime_error("Backend not supported by this CPU");
+    }
+    this->backend = backend;
+    memcpy(this->H, H, 16);
+
+    if (backend == CLMUL || backend == VPCLMUL) {
+        clmul_powers(H, powers, karatsuba);
+    }
+
+    if (backend == TABLE4 || backend == TABLE8) {
+        int bits = (backend == TABLE4) ? 4 : 8;
+        table.resize(2 << bits);
+        buildTable(H, bits, table.data());
+    }
+}
+
+void GHashKey::update(uint8_t* X, const uint8_t* data, size_t length) const {
+    size_t blocks = length / 16;
+    if (blocks > 0) {
+        switch (backend) {
+        case VPCLMUL:
+            ghash_vpclmul(powers, karatsuba, X, data, blocks);
+            break;
+        case CLMUL:
+            ghash_clmul(powers, karatsuba, X, data, blocks);
+            break;
+        case TABLE8:
+            ghash_table8(table.data(), X, data, blocks);
+            break;
+        case TABLE4:
+            ghash_table4(table.data(), X, data, blocks);
+            break;
+        default:
+            ghash_bitwise(H, X, data, blocks);
+            break;
+        }
+    }
+
+    // һĲֲ
+    size_t rest = length % 16;
+    if (rest > 0) {
+        uint8_t block[16] = { 0 };
+        memcpy(block, data + blocks * 16, rest);
+        update(X, block, 16);
+    }
+}
+
+void GHashKey::multiply(uint8_t* X, const uint8_t* Y) const {
+    if (backend == CLMUL || backend == VPCLMUL) {
+        clmul_multiply(X, Y);
+    }
+    else {
+        galois_mult(X, Y, X);
+    }
+}
+
+// ƽ-˷H^0 = 1λΪ 1 Ԫأ
+void GHashKey::power(uint64_t n, uint8_t* result) const {
+    uint8_t base[16];
+    memcpy(base, H, 16);
+    memset(result, 0, 16);
+    result[0] = 0x80;
+    while (n > 0) {
+        if (n & 1) multiply(result, base);
+        n >>= 1;
+        if (n > 0) multiply(base, base);
+    }
+}
+
+const char* GHashKey::backendName() const {
+    switch (backend) {
+    case VPCLMUL: return "vpclmul";
+    case CLMUL:   return "clmul";
+    case TABLE8:  return "table8";
+    case TABLE4:  return "table4";
+    default:      return "bitwise";
+    }
+}
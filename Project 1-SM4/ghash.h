@@ -0,0 +1,63 @@
+#ifndef GHASH_H
+#define GHASH_H
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Galois˷ GF(2^128)λʵ֣οʵ֣
+void galois_mult(const uint8_t* X, const uint8_t* Y, uint8_t* result);
+
+// GHASH ĹϣԿԤ
+// ֻڶ̼߳乲
+class GHashKey {
+public:
+    // ʵַʽAUTO  cpuid ѡʵ
+    enum Backend {
+        AUTO,
+        BITWISE,    // λ˷galois_mult
+        TABLE4,     // Shoup 4 λÿԿ 256 ֽ
+        TABLE8,     // Shoup 8 λÿԿ 4KB
+        CLMUL,      // PCLMULQDQÿ 8 Լһ
+        VPCLMUL     // VPCLMULQDQ + AVX-512һγ 4 
+    };
+
+    // ۺϹԼһδķԤ H^1..H^kPowers
+    static const int kPowers = 8;
+
+    explicit GHashKey(const uint8_t* H, Backend backend = AUTO);
+
+    // H = 0 ռλ󣬹Կȷٸֵĳʹ
+    GHashKey();
+
+    // X = GHASH ״̬16 ֽڣ data еݣX = (X ^ block) * H
+    //  16 ֽڵһ鰴 GCM 
+    void update(uint8_t* X, const uint8_t* data, size_t length) const;
+
+    // X = X * YԪأ
+    void multiply(uint8_t* X, const uint8_t* Y) const;
+
+    // result = H^nںϲֶμ GHASH
+    // ״̬ X  n Ľ = X * H^n ^  0 ʼ n Ľ
+    void power(uint64_t n, uint8_t* result) const;
+
+    // ǰʹõʵ
+    const char* backendName() const;
+
+private:
+    Backend backend;
+
+    // ϣԿ H
+    uint8_t H[16];
+
+    // powers[i] = H^(kPowers - i)ֽʽ CLMUL ֱ루 CLMUL/VPCLMUL
+    alignas(64) uint8_t powers[kPowers][16];
+
+    // Karatsuba мݴθߵ 64 λ 64 λ벿ͬ
+    alignas(64) uint8_t karatsuba[kPowers][16];
+
+    // ʵֵĳ˷table[2 * i], table[2 * i + 1] Ϊ i * H ĸߵ 64 λ
+    // TABLE4 Ϊ 16 TABLE8 Ϊ 256 ʵΪ
+    std::vector<uint64_t> table;
+};
+
+#endif // GHASH_H
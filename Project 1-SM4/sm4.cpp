@@ -1,11 +1,23 @@
 #include "sm4.h"
+#include "sm4_simd.h"
+#include "ghash.h"
+#include "thread_pool.h"
+#include "sm4_stats.h"
+#include "sm4_internal.h"
+#include <algorithm>
+#include <atomic>
 #include <cstring>
 #include <stdexcept>
 #include <immintrin.h>
 #include <vector>
 
+// SM4::Mode Ӧͳģʽ
+#define SM4_STAT_MODE(m) ((m) == SM4::CBC ? MODE_CBC : (m) == SM4::CTR ? MODE_CTR : MODE_ECB)
+
+using namespace sm4internal;
+
 // Sж
-const uint8_t SM4::Sbox[256] = {
+constexpr uint8_t SM4::Sbox[256] = {
     0xd6,0x90,0xe9,0xfe,0xcc,0xe1,0x3d,0xb7,0x16,0xb6,0x14,0xc2,0x28,0xfb,0x2c,0x05,
     0x2b,0x67,0x9a,0x76,0x2a,0xbe,0x04,0xc3,0xaa,0x44,0x13,0x26,0x49,0x86,0x06,0x99,
     0x9c,0x42,0x50,0xf4,0x91,0xef,0x98,0x7a,0x33,0x54,0x0b,0x43,0xed,0xcf,0xac,0x62,
@@ -43,36 +55,96 @@ const uint32_t SM4::CK[32] = {
 
 
 
-// ̬ʼ
-\
-void SM4::SM4TableInitializer() {
+// Ա任L
+constexpr uint32_t SM4::L(uint32_t b) {
+    return b ^
+        ((b << 2) | (b >> 30)) ^  // ѭ2λ
+        ((b << 10) | (b >> 22)) ^ // ѭ10λ
+        ((b << 18) | (b >> 14)) ^ // ѭ18λ
+        ((b << 24) | (b >> 8));   // ѭ24λ
+}
+
+// Ա任L'
+constexpr uint32_t SM4::LPrime(uint32_t b) {
+    return b ^
+        ((b << 13) | (b >> 19)) ^  // ѭ13λ
+        ((b << 23) | (b >> 9));    // ѭ23λ
+}
+
+// TSڵ shift λԱ任
+constexpr std::array<uint32_t, 256> SM4::makeTable(int shift, bool prime) {
+    std::array<uint32_t, 256> t = {};
     for (int i = 0; i < 256; i++) {
-        // T
-        uint32_t w0 = static_cast<uint32_t>(SM4::Sbox[i]) << 24;
-        SM4::T0[i] = SM4::L(w0);
-        uint32_t w1 = static_cast<uint32_t>(SM4::Sbox[i]) << 16;
-        SM4::T1[i] = SM4::L(w1);
-        uint32_t w2 = static_cast<uint32_t>(SM4::Sbox[i]) << 8;
-        SM4::T2[i] = SM4::L(w2);
-        uint32_t w3 = static_cast<uint32_t>(SM4::Sbox[i]);
-        SM4::T3[i] = SM4::L(w3);
-
-        // T'
-        SM4::T0_prime[i] = SM4::LPrime(w0);
-        SM4::T1_prime[i] = SM4::LPrime(w1);
-        SM4::T2_prime[i] = SM4::LPrime(w2);
-        SM4::T3_prime[i] = SM4::LPrime(w3);
+        uint32_t w = static_cast<uint32_t>(Sbox[i]) << shift;
+        t[i] = prime ? LPrime(w) : L(w);
     }
-};
+    return t;
+}
 
+constexpr std::array<uint32_t, 256> SM4::T0 = makeTable(24, false);
+constexpr std::array<uint32_t, 256> SM4::T1 = makeTable(16, false);
+constexpr std::array<uint32_t, 256> SM4::T2 = makeTable(8, false);
+constexpr std::array<uint32_t, 256> SM4::T3 = makeTable(0, false);
+constexpr std::array<uint32_t, 256> SM4::T0_prime = makeTable(24, true);
+constexpr std::array<uint32_t, 256> SM4::T1_prime = makeTable(16, true);
+constexpr std::array<uint32_t, 256> SM4::T2_prime = makeTable(8, true);
+constexpr std::array<uint32_t, 256> SM4::T3_prime = makeTable(0, true);
+
+// ѡں
+const sm4simd::Kernel* SM4::selectKernel(Backend backend) {
+    const sm4simd::Kernel* kernel = nullptr;
+    switch (backend) {
+    case AUTO:
+        return sm4simd::bestKernel();
+    case REFERENCE:
+    case TTABLE:
+        return nullptr;
+    case AVX2:
+        kernel = sm4simd::kernel(sm4simd::KERNEL_AVX2);
+        break;
+    case AVX512:
+        kernel = sm4simd::kernel(sm4simd::KERNEL_AVX512);
+        break;
+    case AESNI:
+        kernel = sm4simd::kernel(sm4simd::KERNEL_AESNI);
+        break;
+    case GFNI:
+        kernel = sm4simd::kernel(sm4simd::KERNEL_GFNI_AVX512);
+        if (!kernel) kernel = sm4simd::kernel(sm4simd::KERNEL_GFNI_AVX2);
+        break;
+    default:
+        throw std::invalid_argument("Invalid backend");
+    }
+    if (!kernel) {
+        throw std::runtime_error("Backend not supported by this CPU");
+    }
+    return kernel;
+}
 
 // 캯
-SM4::SM4(const uint8_t* key, Mode mode) : mode(mode) {
+SM4::SM4(const uint8_t* key, Mode mode, Backend backend) : mode(mode) {
+    // ѡں
+    kernel = selectKernel(backend);
+    useTable = (backend != REFERENCE);
+
     // ʼIV
     memset(iv, 0, 16);
 
     // Կչ
-    keyExpansion(key);
+    keyExpansion(key, useTable, rk);
+    SM4_STAT_KEY_EXPANSIONS(1);
+    SM4_STAT_BACKEND(backendName());
+}
+
+// ԿֻչԿ
+void SM4::rekey(const uint8_t* key) {
+    keyExpansion(key, useTable, rk);
+}
+
+// ǰʹõĺ
+const char* SM4::backendName() const {
+    if (kernel) return kernel->name;
+    return useTable ? "ttable" : "reference";
 }
 
 // óʼ
@@ -81,7 +153,7 @@ void SM4::setIV(const uint8_t* iv) {
 }
 
 // Կչ
-void SM4::keyExpansion(const uint8_t* key) {
+void SM4::keyExpansion(const uint8_t* key, bool useTable, uint32_t* rk) {
     uint32_t K[36];
 
     // ԿתΪ432λ
@@ -92,7 +164,8 @@ void SM4::keyExpansion(const uint8_t* key) {
 
     // 32Կ
     for (int i = 0; i < 32; i++) {
-        K[i + 4] = K[i] ^ TPrime(K[i + 1] ^ K[i + 2] ^ K[i + 3] ^ CK[i]);
+        uint32_t t = K[i + 1] ^ K[i + 2] ^ K[i + 3] ^ CK[i];
+        K[i + 4] = K[i] ^ (useTable ? tableTPrime(t) : TPrime(t));
         rk[i] = K[i + 4];
     }
 }
@@ -116,22 +189,6 @@ uint32_t SM4::tau(uint32_t a) {
     return bytesToWord(bytes);
 }
 
-// Ա任L
-uint32_t SM4::L(uint32_t b) {
-    return b ^
-        ((b << 2) | (b >> 30)) ^  // ѭ2λ
-        ((b << 10) | (b >> 22)) ^ // ѭ10λ
-        ((b << 18) | (b >> 14)) ^ // ѭ18λ
-        ((b << 24) | (b >> 8));   // ѭ24λ
-}
-
-// Ա任L'
-uint32_t SM4::LPrime(uint32_t b) {
-    return b ^
-        ((b << 13) | (b >> 19)) ^  // ѭ13λ
-        ((b << 23) | (b >> 9));    // ѭ23λ
-}
-
 // Ա任S
 uint8_t SM4::S(uint8_t inch) {
     return Sbox[inch];
@@ -147,25 +204,26 @@ uint32_t SM4::TPrime(uint32_t a) {
     return LPrime(tau(a));
 }
 
-////-----------T table -----BEGIN-----------
-//// TʹԤT
-//uint32_t SM4::T(uint32_t a) {
-//    return T0[(a >> 24) & 0xFF] ^
-//        T1[(a >> 16) & 0xFF] ^
-//        T2[(a >> 8) & 0xFF] ^
-//        T3[a & 0xFF];//}
-//
-//// T'ʹԤT'
-//uint32_t SM4::TPrime(uint32_t a) {
-//    return T0_prime[(a >> 24) & 0xFF] ^
-//        T1_prime[(a >> 16) & 0xFF] ^
-//        T2_prime[(a >> 8) & 0xFF] ^
-//        T3_prime[a & 0xFF];
-//}
-////-----------T table -----END-------------
+//-----------T table -----------
+// TʹԤT
+uint32_t SM4::tableT(uint32_t a) {
+    return T0[(a >> 24) & 0xFF] ^
+        T1[(a >> 16) & 0xFF] ^
+        T2[(a >> 8) & 0xFF] ^
+        T3[a & 0xFF];
+}
 
-// ܵ
-void SM4::encryptBlock(const uint8_t* input, uint8_t* output) {
+// T'ʹԤT'
+uint32_t SM4::tableTPrime(uint32_t a) {
+    return T0_prime[(a >> 24) & 0xFF] ^
+        T1_prime[(a >> 16) & 0xFF] ^
+        T2_prime[(a >> 8) & 0xFF] ^
+        T3_prime[a & 0xFF];
+}
+
+// 32ֵ
+void SM4::cryptBlock(const uint32_t* rk, bool reverse, bool useTable,
+    const uint8_t* input, uint8_t* output) {
     uint32_t X[36];
 
     // תΪ432λ
@@ -174,9 +232,15 @@ void SM4::encryptBlock(const uint8_t* input, uint8_t* output) {
     X[2] = bytesToWord(input + 8);
     X[3] = bytesToWord(input + 12);
 
-    // 32ֵ
+    // 32ֵʱʹԿ
     for (int i = 0; i < 32; i++) {
-        X[i + 4] = F(X[i], X[i + 1], X[i + 2], X[i + 3], rk[i]);
+        uint32_t k = reverse ? rk[31 - i] : rk[i];
+        if (useTable) {
+            X[i + 4] = X[i] ^ tableT(X[i + 1] ^ X[i + 2] ^ X[i + 3] ^ k);
+        }
+        else {
+            X[i + 4] = F(X[i], X[i + 1], X[i + 2], X[i + 3], k);
+        }
     }
 
     // 任
@@ -189,29 +253,14 @@ void SM4::encryptBlock(const uint8_t* input, uint8_t* output) {
     wordToBytes(outputWords[3], output + 12);
 }
 
+// ܵ
+void SM4::encryptBlock(const uint8_t* input, uint8_t* output) {
+    cryptBlock(rk, false, useTable, input, output);
+}
+
 // ܵ
 void SM4::decryptBlock(const uint8_t* input, uint8_t* output) {
-    uint32_t X[36];
-
-    // תΪ432λ
-    X[0] = bytesToWord(input);
-    X[1] = bytesToWord(input + 4);
-    X[2] = bytesToWord(input + 8);
-    X[3] = bytesToWord(input + 12);
-
-    // 32ֵʹԿ
-    for (int i = 0; i < 32; i++) {
-        X[i + 4] = F(X[i], X[i + 1], X[i + 2], X[i + 3], rk[31 - i]);
-    }
-
-    // 任
-    uint32_t outputWords[4] = { X[35], X[34], X[33], X[32] };
-
-    // תΪֽ
-    wordToBytes(outputWords[0], output);
-    wordToBytes(outputWords[1], output + 4);
-    wordToBytes(outputWords[2], output + 8);
-    wordToBytes(outputWords[3], output + 12);
+    cryptBlock(rk, true, useTable, input, output);
 }
 
 // ֽת32λ޷
@@ -230,18 +279,353 @@ void SM4::wordToBytes(uint32_t word, uint8_t* bytes) {
     bytes[3] = static_cast<uint8_t>(word & 0xFF);
 }
 
+//-------------CTRģʽ--------------
+
+// ÿ߳ٴƬ̫Сʱ̵߳ȵĿᳬ
+static std::atomic<size_t> parallelMinBytes(256 * 1024);
+
+void sm4_set_parallel_threshold(size_t bytes) {
+    parallelMinBytes = std::max<size_t>(bytes, 16);
+}
+
+// зֵthreads Ϊ 0 ʱ̳߳شСҲ
+static size_t parallel_tasks(size_t length, unsigned threads) {
+    size_t blockCount = (length + 15) / 16;
+    if (threads == 0) {
+        size_t byData = length / parallelMinBytes.load(std::memory_order_relaxed);
+        if (byData <= 1) return 1;
+        threads = static_cast<unsigned>(std::min<size_t>(ThreadPool::shared().size(), byData));
+    }
+    return std::max<size_t>(1, std::min<size_t>(threads, blockCount));
+}
+
+// һɵԿ
+static const size_t kCtrBatchBlocks = 64;
+
+// 64λ˶д
+static inline uint64_t load_be64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void store_be64(uint8_t* p, uint64_t v) {
+    for (int i = 7; i >= 0; i--) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+void sm4internal::counter_add(uint8_t* counter, uint64_t n) {
+    uint64_t hi = load_be64(counter);
+    uint64_t lo = load_be64(counter + 8);
+    lo += n;
+    if (lo < n) hi++;
+    store_be64(counter, hi);
+    store_be64(counter + 8, lo);
+}
+
+// output = a ^ b64λִ
+static inline void xor_bytes(uint8_t* output, const uint8_t* a, const uint8_t* b, size_t length) {
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        uint64_t x, y;
+        memcpy(&x, a + i, 8);
+        memcpy(&y, b + i, 8);
+        x ^= y;
+        memcpy(output + i, &x, 8);
+    }
+    for (; i < length; i++) {
+        output[i] = a[i] ^ b[i];
+    }
+}
+
+// ߳CTRcounter ÿһһʱָһδʹõļֵ
+// encryptBlocks(in, out, n) Ϊܺں
+template <typename BlocksFn>
+static void ctr_crypt_serial(BlocksFn encryptBlocks, uint8_t* counter,
+    const uint8_t* input, size_t length, uint8_t* output) {
+    alignas(64) uint8_t keystream[kCtrBatchBlocks * 16];
+    uint64_t hi = load_be64(counter);
+    uint64_t lo = load_be64(counter + 8);
+
+    while (length > 0) {
+        size_t blocks = std::min(kCtrBatchBlocks, (length + 15) / 16);
+        for (size_t i = 0; i < blocks; i++) {
+            store_be64(keystream + i * 16, hi);
+            store_be64(keystream + i * 16 + 8, lo);
+            if (++lo == 0) hi++;
+        }
+        encryptBlocks(keystream, keystream, blocks);
+
+        size_t bytes = std::min(length, blocks * 16);
+        xor_bytes(output, input, keystream, bytes);
+        input += bytes;
+        output += bytes;
+        length -= bytes;
+    }
+
+    store_be64(counter, hi);
+    store_be64(counter + 8, lo);
+}
+
+// ߳CTRз֣ÿԼļƫƿʼ
+template <typename BlocksFn>
+static void ctr_crypt(BlocksFn encryptBlocks, const uint8_t* counter,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads) {
+    size_t blockCount = (length + 15) / 16;
+    size_t tasks = parallel_tasks(length, threads);
+    size_t blocksPerTask = (blockCount + tasks - 1) / tasks;
+    auto task = [&](size_t t) {
+        size_t begin = t * blocksPerTask * 16;
+        if (begin >= length) return;
+        size_t bytes = std::min(length - begin, blocksPerTask * 16);
+
+        uint8_t ctr[16];
+        memcpy(ctr, counter, 16);
+        counter_add(ctr, t * blocksPerTask);
+        ctr_crypt_serial(encryptBlocks, ctr, input + begin, bytes, output + begin);
+    };
+
+    if (tasks == 1) {
+        task(0);
+    }
+    else {
+        ThreadPool::shared().parallelFor(tasks, task);
+    }
+}
+
+void sm4_ctr_crypt(
+    const SM4Key& key, const uint8_t* counter,
+    const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads) {
+    if (length == 0) return;
+    if (!counter || !input || !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    SM4_STAT_BYTES(MODE_CTR, ENCRYPT, length);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+    sm4internal::ctr_crypt(key, counter, input, length, output, threads);
+}
+
+void sm4internal::ctr_crypt(const SM4Key& key, const uint8_t* counter,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads) {
+    ::ctr_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { key.encryptBlocks(in, out, n); },
+        counter, input, length, output, threads);
+}
+
+//-------------CBCģʽ--------------
+
+// CBC ÿķܽ L1 
+static const size_t kCbcBatchBlocks = 256;
+
+// ߳CBCܣprev Ϊһ֮ǰĿ
+// ÿں˽ܣǰһĿ
+// β׽УԭؽʱÿĿڱǰѾ
+template <typename BlocksFn>
+static void cbc_decrypt_serial(BlocksFn decryptBlocks, const uint8_t* prev,
+    const uint8_t* input, size_t blockCount, uint8_t* output) {
+    alignas(64) uint8_t plain[kCbcBatchBlocks * 16];
+    uint8_t chain[16];
+    uint8_t nextChain[16];
+    memcpy(chain, prev, 16);
+
+    while (blockCount > 0) {
+        size_t blocks = std::min(kCbcBatchBlocks, blockCount);
+        decryptBlocks(input, plain, blocks);
+        memcpy(nextChain, input + (blocks - 1) * 16, 16);
+
+        for (size_t i = blocks - 1; i > 0; i--) {
+            xor_bytes(output + i * 16, plain + i * 16, input + (i - 1) * 16, 16);
+        }
+        xor_bytes(output, plain, chain, 16);
+
+        memcpy(chain, nextChain, 16);
+        input += blocks * 16;
+        output += blocks * 16;
+        blockCount -= blocks;
+    }
+}
+
+// ߳CBCܣÿʼֵǰȡ
+// ԭؽʱ񸲸ǵĿ鲻ٱȡ
+template <typename BlocksFn>
+static void cbc_decrypt(BlocksFn decryptBlocks, const uint8_t* iv,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads) {
+    size_t blockCount = length / 16;
+    size_t tasks = parallel_tasks(length, threads);
+    if (tasks == 1) {
+        cbc_decrypt_serial(decryptBlocks, iv, input, blockCount, output);
+        return;
+    }
+
+    size_t blocksPerTask = (blockCount + tasks - 1) / tasks;
+    std::vector<uint8_t> chains(tasks * 16);
+    memcpy(chains.data(), iv, 16);
+    for (size_t t = 1; t < tasks; t++) {
+        size_t begin = t * blocksPerTask;
+        if (begin < blockCount) {
+            memcpy(chains.data() + t * 16, input + (begin - 1) * 16, 16);
+        }
+    }
+
+    ThreadPool::shared().parallelFor(tasks, [&](size_t t) {
+        size_t begin = t * blocksPerTask;
+        if (begin >= blockCount) return;
+        size_t blocks = std::min(blockCount - begin, blocksPerTask);
+        cbc_decrypt_serial(decryptBlocks, chains.data() + t * 16,
+            input + begin * 16, blocks, output + begin * 16);
+    });
+}
+
+void sm4_cbc_decrypt(
+    const SM4Key& key, const uint8_t* iv,
+    const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads) {
+    if (length == 0) return;
+    if (length % 16 != 0 || !iv || !input || !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    SM4_STAT_BYTES(MODE_CBC, DECRYPT, length);
+    SM4_STAT_CYCLES(CALL_DECRYPT);
+    cbc_decrypt([&](const uint8_t* in, uint8_t* out, size_t n) { key.decryptBlocks(in, out, n); },
+        iv, input, length, output, threads);
+}
+
+// ̶߳໺CBCܣkeys[i] Ϊ jobs[i] ļԿ
+// ͨбһĿ飨ֵÿһȡһķȥ
+static void cbc_encrypt_lanes(const sm4simd::Kernel* kernel, const uint32_t* table,
+    const uint32_t* const* keys, const SM4CbcJob* jobs, size_t count) {
+    static const size_t kMaxLanes = 64;
+
+    // ʱֻʹͨԽԽ
+    size_t lanes = std::min(std::min(kernel->lanes, kMaxLanes),
+        (count + kernel->width - 1) / kernel->width * kernel->width);
+
+    alignas(64) uint32_t rk[32 * kMaxLanes] = { 0 };
+    alignas(64) uint8_t blocks[kMaxLanes * 16] = { 0 };
+    // ͨĶдλʣremaining Ϊ 0 ʾͨ
+    const uint8_t* src[kMaxLanes];
+    uint8_t* dst[kMaxLanes];
+    size_t remaining[kMaxLanes];
+    size_t next = 0;
+    size_t active = 0;
+
+    // һǿװͨ l
+    auto assign = [&](size_t l) {
+        while (next < count && jobs[next].length == 0) next++;
+        if (next == count) {
+            remaining[l] = 0;
+            return;
+        }
+        src[l] = jobs[next].input;
+        dst[l] = jobs[next].output;
+        remaining[l] = jobs[next].length / 16;
+        memcpy(blocks + l * 16, jobs[next].iv, 16);
+        for (int r = 0; r < 32; r++) {
+            rk[r * lanes + l] = keys[next][r];
+        }
+        next++;
+        active++;
+    };
+
+    for (size_t l = 0; l < lanes; l++) {
+        assign(l);
+    }
+
+    while (active > 0) {
+        for (size_t l = 0; l < lanes; l++) {
+            if (remaining[l]) {
+                xor_bytes(blocks + l * 16, blocks + l * 16, src[l], 16);
+                src[l] += 16;
+            }
+        }
+
+        kernel->cryptLanes(rk, lanes, table, blocks, blocks, lanes);
+
+        for (size_t l = 0; l < lanes; l++) {
+            if (!remaining[l]) continue;
+            memcpy(dst[l], blocks + l * 16, 16);
+            dst[l] += 16;
+            if (--remaining[l] == 0) {
+                active--;
+                assign(l);
+            }
+        }
+    }
+}
+
+void sm4_cbc_encrypt_multi(const SM4CbcJob* jobs, size_t count, unsigned threads) {
+    if (count == 0) return;
+    if (!jobs) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    // Կʹͬһںʱܽ֯м
+    const sm4simd::Kernel* kernel = jobs[0].key ? jobs[0].key->kernel : nullptr;
+    size_t totalLength = 0;
+    for (size_t i = 0; i < count; i++) {
+        const SM4CbcJob& job = jobs[i];
+        if (!job.key || job.length % 16 != 0 ||
+            (job.length > 0 && (!job.iv || !job.input || !job.output))) {
+            throw std::invalid_argument("Invalid input parameters");
+        }
+        if (job.key->kernel != kernel) kernel = nullptr;
+        totalLength += job.length;
+    }
+
+    if (!kernel) {
+        for (size_t i = 0; i < count; i++) {
+            if (jobs[i].length == 0) continue;
+            SM4Context ctx(*jobs[i].key, SM4::CBC, jobs[i].iv);
+            ctx.encryptBlocks(jobs[i].input, jobs[i].length, jobs[i].output);
+        }
+        return;
+    }
+
+    SM4_STAT_BYTES(MODE_CBC, ENCRYPT, totalLength);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+    std::vector<const uint32_t*> keys(count);
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = jobs[i].key->rk;
+    }
+    const uint32_t* table = SM4::T3.data();
+
+    // ߳ʱз
+    size_t tasks = std::min(parallel_tasks(totalLength, threads), count);
+    if (tasks <= 1) {
+        cbc_encrypt_lanes(kernel, table, keys.data(), jobs, count);
+        return;
+    }
+    size_t jobsPerTask = (count + tasks - 1) / tasks;
+    ThreadPool::shared().parallelFor(tasks, [&](size_t t) {
+        size_t begin = t * jobsPerTask;
+        if (begin >= count) return;
+        size_t n = std::min(count - begin, jobsPerTask);
+        cbc_encrypt_lanes(kernel, table, keys.data() + begin, jobs + begin, n);
+    });
+}
+
 // ܺ
 int SM4::encrypt(const uint8_t* plaintext, int length, uint8_t* ciphertext) {
     if (length <= 0 || !plaintext || !ciphertext) {
         throw std::invalid_argument("Invalid input parameters");
     }
+    SM4_STAT_BYTES(SM4_STAT_MODE(mode), ENCRYPT, length);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+
+    // CTRģʽ䣬ȳ
+    if (mode == CTR) {
+        ctr_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { cryptBlocks(kernel, useTable, rk, in, out, n); },
+            iv, plaintext, length, ciphertext, 0);
+        return length;
+    }
 
     int blockCount = (length + 15) / 16;  // ҪĿ
     uint8_t inputBlock[16] = { 0 };
     uint8_t outputBlock[16] = { 0 };
     uint8_t currentIV[16];
     memcpy(currentIV, iv, 16);
-    // SM4TableInitializer(); //ѡʹT
 
     for (int i = 0; i < blockCount; i++) {
         // ݵ
@@ -282,48 +666,41 @@ int SM4::encrypt(const uint8_t* plaintext, int length, uint8_t* ciphertext) {
 
 // ܺ
 int SM4::decrypt(const uint8_t* ciphertext, int length, uint8_t* plaintext) {
+    // CTRģʽͬ
+    if (mode == CTR) {
+        return encrypt(ciphertext, length, plaintext);
+    }
+
     if (length <= 0 || length % 16 != 0 || !ciphertext || !plaintext) {
         throw std::invalid_argument("Invalid input parameters");
     }
-
-    int blockCount = length / 16;  // 
-    uint8_t inputBlock[16] = { 0 };
-    uint8_t outputBlock[16] = { 0 };
-    uint8_t currentIV[16];
-    memcpy(currentIV, iv, 16);
-    uint8_t prevBlock[16];
-
-    for (int i = 0; i < blockCount; i++) {
-        // Ƶǰ
-        memcpy(inputBlock, ciphertext + i * 16, 16);
-        memcpy(prevBlock, inputBlock, 16);
-
-        // ܵǰ
-        decryptBlock(inputBlock, outputBlock);
-
-        // ģʽ
-        if (mode == CBC) {
-            // CBCģʽҪIV
-            for (int j = 0; j < 16; j++) {
-                outputBlock[j] ^= currentIV[j];
-            }
-            // IVΪǰһĿ
-            memcpy(currentIV, prevBlock, 16);
+    SM4_STAT_BYTES(SM4_STAT_MODE(mode), DECRYPT, length);
+    SM4_STAT_CYCLES(CALL_DECRYPT);
+
+    if (mode == CBC) {
+        // CBCģʽζܺǰһĿ
+        uint32_t drk[32];
+        for (int i = 0; i < 32; i++) {
+            drk[i] = rk[31 - i];
         }
-
-        // ƽ
-        memcpy(plaintext + i * 16, outputBlock, 16);
+        cbc_decrypt([&](const uint8_t* in, uint8_t* out, size_t n) { cryptBlocks(kernel, useTable, drk, in, out, n); },
+            iv, ciphertext, length, plaintext, 0);
+    }
+    else {
+        decryptBlocksAVX2(ciphertext, plaintext, length / 16);
     }
 
     // 
     uint8_t padValue = plaintext[length - 1];
     if (padValue > 16) {
+        SM4_STAT_PADDING_FAILURE();
         throw std::runtime_error("Invalid padding");
     }
 
     // ֤
     for (int i = length - padValue; i < length; i++) {
         if (plaintext[i] != padValue) {
+            SM4_STAT_PADDING_FAILURE();
             throw std::runtime_error("Invalid padding");
         }
     }
@@ -333,41 +710,20 @@ int SM4::decrypt(const uint8_t* ciphertext, int length, uint8_t* plaintext) {
 
 //-------------SIMD Ż--------------------
 
-void SM4::encryptBlocksAVX2(const uint8_t* inputs, uint8_t* outputs, int blockCount) {
-    int i = 0;
-    alignas(32) uint8_t tempIn[4][16];
-    alignas(32) uint8_t tempOut[4][16];
-
-    // ÿִ4
-    for (; i + 3 < blockCount; i += 4) {
-        // 4飨Ƕ룩
-        __m128i in0 = _mm_loadu_si128((__m128i*)(inputs + (i + 0) * 16));
-        __m128i in1 = _mm_loadu_si128((__m128i*)(inputs + (i + 1) * 16));
-        __m128i in2 = _mm_loadu_si128((__m128i*)(inputs + (i + 2) * 16));
-        __m128i in3 = _mm_loadu_si128((__m128i*)(inputs + (i + 3) * 16));
-
-        // ʱʹ encryptBlock ã
-        _mm_store_si128((__m128i*)tempIn[0], in0);
-        _mm_store_si128((__m128i*)tempIn[1], in1);
-        _mm_store_si128((__m128i*)tempIn[2], in2);
-        _mm_store_si128((__m128i*)tempIn[3], in3);
-
-        // ÿ encryptBlock
-        for (int j = 0; j < 4; j++) {
-            encryptBlock(tempIn[j], tempOut[j]);
+// ӽܣжںʱѶתõĴв 32 ֵ
+void SM4::cryptBlocks(const sm4simd::Kernel* kernel, bool useTable, const uint32_t* rk,
+    const uint8_t* inputs, uint8_t* outputs, size_t blockCount) {
+    if (!kernel) {
+        for (size_t i = 0; i < blockCount; i++) {
+            cryptBlock(rk, false, useTable, inputs + i * 16, outputs + i * 16);
         }
-
-        // дؽ
-        _mm_storeu_si128((__m128i*)(outputs + (i + 0) * 16), _mm_load_si128((__m128i*)tempOut[0]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 1) * 16), _mm_load_si128((__m128i*)tempOut[1]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 2) * 16), _mm_load_si128((__m128i*)tempOut[2]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 3) * 16), _mm_load_si128((__m128i*)tempOut[3]));
+        return;
     }
+    kernel->crypt(rk, T3.data(), inputs, outputs, blockCount);
+}
 
-    // ʣ
-    for (; i < blockCount; i++) {
-        encryptBlock(inputs + i * 16, outputs + i * 16);
-    }
+void SM4::encryptBlocksAVX2(const uint8_t* inputs, uint8_t* outputs, int blockCount) {
+    cryptBlocks(kernel, useTable, rk, inputs, outputs, blockCount);
 }
 
 
@@ -376,22 +732,29 @@ int SM4::encrypt_simd(const uint8_t* plaintext, int length, uint8_t* ciphertext)
         throw std::invalid_argument("Invalid input parameters");
     }
 
+    // CTRģʽʹöںԿ
+    if (mode == CTR) {
+        return encrypt(plaintext, length, ciphertext);
+    }
+    SM4_STAT_BYTES(SM4_STAT_MODE(mode), ENCRYPT, length);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+
     int blockCount = (length + 15) / 16;
     int paddedLength = blockCount * 16;
+    int fullLength = length - length % 16;
 
-    // 䣩
-    std::vector<uint8_t> paddedInput(paddedLength, 0);
-    memcpy(paddedInput.data(), plaintext, length);
-
-    //  PKCS#7 
+    // ֻһķҪ PKCS#7 䣬ջϴ
+    uint8_t lastBlock[16];
     uint8_t padValue = paddedLength - length;
-    for (int i = length; i < paddedLength; i++) {
-        paddedInput[i] = padValue;
-    }
+    memcpy(lastBlock, plaintext + fullLength, length - fullLength);
+    memset(lastBlock + (length - fullLength), padValue, padValue);
 
     if (mode == ECB) {
         // ֱʹ SIMD ŻĶܺ
-        encryptBlocksAVX2(paddedInput.data(), ciphertext, blockCount);
+        encryptBlocksAVX2(plaintext, ciphertext, fullLength / 16);
+        if (fullLength < length) {
+            encryptBlocksAVX2(lastBlock, ciphertext + fullLength, 1);
+        }
     }
     else if (mode == CBC) {
         // CBC ģʽ鴮м
@@ -401,11 +764,11 @@ int SM4::encrypt_simd(const uint8_t* plaintext, int length, uint8_t* ciphertext)
         memcpy(currentIV, iv, 16);
 
         for (int i = 0; i < blockCount; i++) {
-            memcpy(inputBlock, paddedInput.data() + i * 16, 16);
+            const uint8_t* block = (i * 16 < fullLength) ? plaintext + i * 16 : lastBlock;
 
             // CBCģʽҪIV
             for (int j = 0; j < 16; j++) {
-                inputBlock[j] ^= currentIV[j];
+                inputBlock[j] = block[j] ^ currentIV[j];
             }
 
             encryptBlock(inputBlock, outputBlock);
@@ -424,41 +787,26 @@ int SM4::encrypt_simd(const uint8_t* plaintext, int length, uint8_t* ciphertext)
 
 
 void SM4::decryptBlocksAVX2(const uint8_t* inputs, uint8_t* outputs, int blockCount) {
-    int i = 0;
-    alignas(32) uint8_t tempIn[4][16];
-    alignas(32) uint8_t tempOut[4][16];
-
-    for (; i + 3 < blockCount; i += 4) {
-        __m128i in0 = _mm_loadu_si128((__m128i*)(inputs + (i + 0) * 16));
-        __m128i in1 = _mm_loadu_si128((__m128i*)(inputs + (i + 1) * 16));
-        __m128i in2 = _mm_loadu_si128((__m128i*)(inputs + (i + 2) * 16));
-        __m128i in3 = _mm_loadu_si128((__m128i*)(inputs + (i + 3) * 16));
-
-        _mm_store_si128((__m128i*)tempIn[0], in0);
-        _mm_store_si128((__m128i*)tempIn[1], in1);
-        _mm_store_si128((__m128i*)tempIn[2], in2);
-        _mm_store_si128((__m128i*)tempIn[3], in3);
-
-        for (int j = 0; j < 4; j++) {
-            decryptBlock(tempIn[j], tempOut[j]);
-        }
-
-        _mm_storeu_si128((__m128i*)(outputs + (i + 0) * 16), _mm_load_si128((__m128i*)tempOut[0]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 1) * 16), _mm_load_si128((__m128i*)tempOut[1]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 2) * 16), _mm_load_si128((__m128i*)tempOut[2]));
-        _mm_storeu_si128((__m128i*)(outputs + (i + 3) * 16), _mm_load_si128((__m128i*)tempOut[3]));
-    }
-
-    for (; i < blockCount; i++) {
-        decryptBlock(inputs + i * 16, outputs + i * 16);
+    // ܽṹͬԿ
+    uint32_t drk[32];
+    for (int i = 0; i < 32; i++) {
+        drk[i] = rk[31 - i];
     }
+    cryptBlocks(kernel, useTable, drk, inputs, outputs, blockCount);
 }
 
 int SM4::decrypt_simd(const uint8_t* ciphertext, int length, uint8_t* plaintext) {
+    if (mode == CTR) {
+        return encrypt(ciphertext, length, plaintext);
+    }
+
     if (length <= 0 || length % 16 != 0 || !ciphertext || !plaintext) {
         throw std::invalid_argument("Invalid input parameters");
     }
 
+    SM4_STAT_BYTES(SM4_STAT_MODE(mode), DECRYPT, length);
+    SM4_STAT_CYCLES(CALL_DECRYPT);
+
     int blockCount = length / 16;
 
     if (mode == ECB) {
@@ -466,36 +814,25 @@ int SM4::decrypt_simd(const uint8_t* ciphertext, int length, uint8_t* plaintext)
         decryptBlocksAVX2(ciphertext, plaintext, blockCount);
     }
     else if (mode == CBC) {
-        //  CBC ģʽÿҪǰһĿ
-        uint8_t inputBlock[16] = { 0 };
-        uint8_t outputBlock[16] = { 0 };
-        uint8_t currentIV[16];
-        uint8_t prevBlock[16];
-        memcpy(currentIV, iv, 16);
-
-        for (int i = 0; i < blockCount; i++) {
-            memcpy(inputBlock, ciphertext + i * 16, 16);
-            memcpy(prevBlock, inputBlock, 16);
-
-            decryptBlock(inputBlock, outputBlock);
-
-            for (int j = 0; j < 16; j++) {
-                outputBlock[j] ^= currentIV[j];
-            }
-
-            memcpy(currentIV, prevBlock, 16);
-            memcpy(plaintext + i * 16, outputBlock, 16);
+        // ܻνں˺ͳһ
+        uint32_t drk[32];
+        for (int i = 0; i < 32; i++) {
+            drk[i] = rk[31 - i];
         }
+        cbc_decrypt([&](const uint8_t* in, uint8_t* out, size_t n) { cryptBlocks(kernel, useTable, drk, in, out, n); },
+            iv, ciphertext, length, plaintext, 0);
     }
 
     // 
     uint8_t padValue = plaintext[length - 1];
     if (padValue > 16 || padValue == 0) {
+        SM4_STAT_PADDING_FAILURE();
         throw std::runtime_error("Invalid padding");
     }
 
     for (int i = length - padValue; i < length; i++) {
         if (plaintext[i] != padValue) {
+            SM4_STAT_PADDING_FAILURE();
             throw std::runtime_error("Invalid padding");
         }
     }
@@ -503,73 +840,715 @@ int SM4::decrypt_simd(const uint8_t* ciphertext, int length, uint8_t* plaintext)
     return length - padValue;
 }
 
-//-------------SM4-GCMģʽ--------------
+//-------------Կչ--------------
+
+void sm4_expand_keys(const uint8_t* keys, size_t count, uint32_t* rk, SM4::Backend backend) {
+    if (count == 0) return;
+    if (!keys || !rk) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    // Կͨչµչд
+    const sm4simd::Kernel* kernel = SM4::selectKernel(backend);
+    bool useTable = (backend != SM4::REFERENCE);
+    size_t done = 0;
+    if (kernel) {
+        done = count / kernel->width * kernel->width;
+        if (done > 0) {
+            kernel->expandKeys(SM4::FK, SM4::CK, SM4::T3_prime.data(), keys, rk, count, done);
+        }
+    }
+    for (size_t i = done; i < count; i++) {
+        uint32_t k[32];
+        SM4::keyExpansion(keys + i * 16, useTable, k);
+        for (int r = 0; r < 32; r++) {
+            rk[r * count + i] = k[r];
+        }
+    }
+    SM4_STAT_KEY_EXPANSIONS(count);
+}
+
+void sm4_encrypt_lanes(const uint32_t* rk, size_t count, const uint8_t* input, uint8_t* output,
+    SM4::Backend backend)
+{
+    if (count == 0) return;
+    if (!rk || !input || !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    const sm4simd::Kernel* kernel = SM4::selectKernel(backend);
+    bool useTable = (backend != SM4::REFERENCE);
+    size_t done = 0;
+    if (kernel) {
+        done = count / kernel->width * kernel->width;
+        if (done > 0) {
+            kernel->cryptLanes(rk, count, SM4::T3.data(), input, output, done);
+        }
+    }
+    for (size_t i = done; i < count; i++) {
+        uint32_t k[32];
+        for (int r = 0; r < 32; r++) {
+            k[r] = rk[r * count + i];
+        }
+        SM4::cryptBlock(k, false, useTable, input + i * 16, output + i * 16);
+    }
+}
+
+//-------------Կ--------------
+
+SM4Key::SM4Key(const uint8_t* key, SM4::Backend backend) {
+    kernel = SM4::selectKernel(backend);
+    useTable = (backend != SM4::REFERENCE);
+
+    // ԿչԤ׼ĽԿ
+    SM4::keyExpansion(key, useTable, rk);
+    for (int i = 0; i < 32; i++) {
+        drk[i] = rk[31 - i];
+    }
+    SM4_STAT_KEY_EXPANSIONS(1);
+    SM4_STAT_BACKEND(backendName());
+
+    // H = E_K(0)Լ GHASH Ԥ
+    memset(H, 0, 16);
+    encryptBlock(H, H);
+    ghash = GHashKey(H);
+}
+
+void SM4Key::encryptBlock(const uint8_t* input, uint8_t* output) const {
+    SM4::cryptBlock(rk, false, useTable, input, output);
+}
+
+void SM4Key::decryptBlock(const uint8_t* input, uint8_t* output) const {
+    SM4::cryptBlock(drk, false, useTable, input, output);
+}
+
+void SM4Key::encryptBlocks(const uint8_t* inputs, uint8_t* outputs, size_t blockCount) const {
+    SM4::cryptBlocks(kernel, useTable, rk, inputs, outputs, blockCount);
+}
+
+void SM4Key::decryptBlocks(const uint8_t* inputs, uint8_t* outputs, size_t blockCount) const {
+    SM4::cryptBlocks(kernel, useTable, drk, inputs, outputs, blockCount);
+}
+
+const char* SM4Key::backendName() const {
+    if (kernel) return kernel->name;
+    return useTable ? "ttable" : "reference";
+}
+
+SM4Context::SM4Context(const SM4Key& key, SM4::Mode mode, const uint8_t* iv) : key(&key), mode(mode) {
+    if (iv) {
+        memcpy(this->iv, iv, 16);
+    }
+    else {
+        memset(this->iv, 0, 16);
+    }
+    memcpy(chain, this->iv, 16);
+    keystreamUsed = 16;
+    encrypting = true;
+    padding = true;
+    partialLength = 0;
+}
+
+void SM4Context::setIV(const uint8_t* iv) {
+    memcpy(this->iv, iv, 16);
+    memcpy(chain, iv, 16);
+    keystreamUsed = 16;
+    partialLength = 0;
+}
+
+void SM4Context::ctrCrypt(const uint8_t* input, size_t length, uint8_t* output) {
+    if (length > 0 && (!input || !output)) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    [[maybe_unused]] size_t total = length;
+
+    // һʣԿ
+    while (length > 0 && keystreamUsed < 16) {
+        *output++ = *input++ ^ keystream[keystreamUsed++];
+        length--;
+    }
+
+    // 鲿֣ʱ߳з֣ sm4_ctr_crypt ͳƣ
+    size_t fullLength = length - length % 16;
+    SM4_STAT_BYTES(MODE_CTR, ENCRYPT, total - fullLength);
+    if (fullLength > 0) {
+        sm4_ctr_crypt(*key, chain, input, fullLength, output);
+        counter_add(chain, fullLength / 16);
+        input += fullLength;
+        output += fullLength;
+        length -= fullLength;
+    }
+
+    // һβʣԿһε
+    if (length > 0) {
+        key->encryptBlock(chain, keystream);
+        counter_add(chain, 1);
+        for (size_t i = 0; i < length; i++) {
+            output[i] = input[i] ^ keystream[i];
+        }
+        keystreamUsed = length;
+    }
+}
 
-// Galois˷ GF(2^128)
-void galois_mult(const uint8_t* X, const uint8_t* Y, uint8_t* result) {
-    uint8_t Z[16] = { 0 };
-    uint8_t V[16];
-    memcpy(V, Y, 16);
+void SM4Context::encryptBlocks(const uint8_t* input, size_t length, uint8_t* output) {
+    if (length % 16 != 0 || (length > 0 && (!input || !output))) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    size_t blockCount = length / 16;
 
-    for (int i = 0; i < 128; i++) {
-        int byteIndex = i / 8;
-        int bitIndex = 7 - (i % 8);
-        if ((X[byteIndex] >> bitIndex) & 1) {
+    if (mode == SM4::ECB) {
+        SM4_STAT_BYTES(MODE_ECB, ENCRYPT, length);
+        key->encryptBlocks(input, output, blockCount);
+    }
+    else if (mode == SM4::CTR) {
+        ctrCrypt(input, length, output);
+    }
+    else if (mode == SM4::CBC) {
+        SM4_STAT_BYTES(MODE_CBC, ENCRYPT, length);
+        uint8_t block[16];
+        for (size_t i = 0; i < blockCount; i++) {
             for (int j = 0; j < 16; j++) {
-                Z[j] ^= V[j];
+                block[j] = input[i * 16 + j] ^ chain[j];
             }
+            key->encryptBlock(block, chain);
+            memcpy(output + i * 16, chain, 16);
         }
+    }
+    else {
+        throw std::runtime_error("Unsupported mode");
+    }
+}
+
+void SM4Context::decryptBlocks(const uint8_t* input, size_t length, uint8_t* output) {
+    if (length % 16 != 0 || (length > 0 && (!input || !output))) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    size_t blockCount = length / 16;
 
-        bool lsb = V[15] & 1;
-        for (int j = 15; j > 0; j--) {
-            V[j] = (V[j] >> 1) | ((V[j - 1] & 1) << 7);
+    if (mode == SM4::ECB) {
+        SM4_STAT_BYTES(MODE_ECB, DECRYPT, length);
+        key->decryptBlocks(input, output, blockCount);
+    }
+    else if (mode == SM4::CTR) {
+        ctrCrypt(input, length, output);
+    }
+    else if (mode == SM4::CBC) {
+        // ȱһĿΪһεõֵ input  output ָͬһ
+        if (blockCount > 0) {
+            uint8_t last[16];
+            memcpy(last, input + length - 16, 16);
+            sm4_cbc_decrypt(*key, chain, input, length, output);
+            memcpy(chain, last, 16);
         }
-        V[0] >>= 1;
-        if (lsb) V[0] ^= 0xe1;
     }
-    memcpy(result, Z, 16);
+    else {
+        throw std::runtime_error("Unsupported mode");
+    }
 }
 
-// GHASH(AAD, C)
-void ghash(const uint8_t* H, const std::vector<uint8_t>& aad, const std::vector<uint8_t>& ciphertext, uint8_t* output) {
-    std::vector<uint8_t> X(16, 0);
+// һԼܣECB/CBC ׷ 1~16 ֽڵ PKCS#7 
+size_t SM4Context::encrypt(const uint8_t* plaintext, size_t length, uint8_t* ciphertext) {
+    if (mode == SM4::CTR) {
+        memcpy(chain, iv, 16);
+        keystreamUsed = 16;
+        ctrCrypt(plaintext, length, ciphertext);
+        memcpy(chain, iv, 16);
+        keystreamUsed = 16;
+        return length;
+    }
+
+    if ((length > 0 && !plaintext) || !ciphertext) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
 
-    auto ghash_update = [&](const std::vector<uint8_t>& data) {
-        for (size_t i = 0; i < data.size(); i += 16) {
-            uint8_t block[16] = { 0 };
-            size_t len = std::min((size_t)16, data.size() - i);
-            memcpy(block, &data[i], len);
-            for (int j = 0; j < 16; j++) {
-                X[j] ^= block[j];
+    size_t fullLength = length - length % 16;
+    uint8_t lastBlock[16];
+    uint8_t padValue = static_cast<uint8_t>(16 - length % 16);
+    memcpy(lastBlock, plaintext + fullLength, length - fullLength);
+    memset(lastBlock + (length - fullLength), padValue, padValue);
+
+    memcpy(chain, iv, 16);
+    encryptBlocks(plaintext, fullLength, ciphertext);
+    encryptBlocks(lastBlock, 16, ciphertext + fullLength);
+    memcpy(chain, iv, 16);
+
+    return fullLength + 16;
+}
+
+// һԽܣECB/CBC ȥУ PKCS#7 
+size_t SM4Context::decrypt(const uint8_t* ciphertext, size_t length, uint8_t* plaintext) {
+    if (mode == SM4::CTR) {
+        return encrypt(ciphertext, length, plaintext);
+    }
+
+    if (length == 0 || length % 16 != 0 || !ciphertext || !plaintext) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    memcpy(chain, iv, 16);
+    decryptBlocks(ciphertext, length, plaintext);
+    memcpy(chain, iv, 16);
+
+    uint8_t padValue = plaintext[length - 1];
+    if (padValue == 0 || padValue > 16) {
+        SM4_STAT_PADDING_FAILURE();
+        throw std::runtime_error("Invalid padding");
+    }
+    for (size_t i = length - padValue; i < length; i++) {
+        if (plaintext[i] != padValue) {
+            SM4_STAT_PADDING_FAILURE();
+            throw std::runtime_error("Invalid padding");
+        }
+    }
+
+    return length - padValue;
+}
+
+//-------------ʽӿ--------------
+
+// 鲻ʱջϻתС
+static const size_t kStreamStageBytes = 4096;
+
+void SM4Context::init(bool encrypt) {
+    encrypting = encrypt;
+    memcpy(chain, iv, 16);
+    keystreamUsed = 16;
+    partialLength = 0;
+}
+
+size_t SM4Context::update(const uint8_t* input, size_t length, uint8_t* output) {
+    if (length == 0) return 0;
+    if (!input || !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    // CTR ܴⳤ
+    if (mode == SM4::CTR) {
+        ctrCrypt(input, length, output);
+        return length;
+    }
+
+    // ʱʼձһ飨ܺ䣩 1 ֽڸһλ final
+    size_t keep = (encrypting || !padding) ? 0 : 1;
+    size_t written = 0;
+
+    // ûвʱֱӴ input  output
+    if (partialLength == 0 && length > keep) {
+        size_t direct = (length - keep) / 16 * 16;
+        if (encrypting) encryptBlocks(input, direct, output);
+        else decryptBlocks(input, direct, output);
+        input += direct;
+        output += direct;
+        length -= direct;
+        written += direct;
+    }
+
+    // вʱֽջϻת
+    // ԭشʱдһ֮ǰȰѻᱻǵ
+    alignas(64) uint8_t stage[kStreamStageBytes];
+    while (partialLength > 0 && partialLength + length >= 16 + keep) {
+        size_t bytes = std::min((partialLength + length - keep) / 16 * 16, kStreamStageBytes);
+        size_t fresh = bytes - partialLength;
+        memcpy(stage, partial, partialLength);
+        memcpy(stage + partialLength, input, fresh);
+        input += fresh;
+        length -= fresh;
+
+        partialLength = std::min(partialLength, length);
+        memcpy(partial, input, partialLength);
+        input += partialLength;
+        length -= partialLength;
+
+        if (encrypting) encryptBlocks(stage, bytes, stage);
+        else decryptBlocks(stage, bytes, stage);
+        memcpy(output, stage, bytes);
+        output += bytes;
+        written += bytes;
+    }
+
+    memcpy(partial + partialLength, input, length);
+    partialLength += length;
+    return written;
+}
+
+size_t SM4Context::final(uint8_t* output) {
+    if (mode == SM4::CTR) {
+        init(encrypting);
+        return 0;
+    }
+    if (!padding) {
+        bool aligned = partialLength == 0;
+        init(encrypting);
+        if (!aligned) {
+            throw std::runtime_error("Invalid data length");
+        }
+        return 0;
+    }
+    if (!output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    if (encrypting) {
+        uint8_t padValue = static_cast<uint8_t>(16 - partialLength);
+        memset(partial + partialLength, padValue, padValue);
+        encryptBlocks(partial, 16, output);
+        init(true);
+        return 16;
+    }
+
+    if (partialLength != 16) {
+        init(false);
+        throw std::runtime_error("Invalid ciphertext length");
+    }
+    uint8_t block[16];
+    decryptBlocks(partial, 16, block);
+    init(false);
+
+    uint8_t padValue = block[15];
+    if (padValue == 0 || padValue > 16) {
+        SM4_STAT_PADDING_FAILURE();
+        throw std::runtime_error("Invalid padding");
+    }
+    for (int i = 16 - padValue; i < 16; i++) {
+        if (block[i] != padValue) {
+            SM4_STAT_PADDING_FAILURE();
+            throw std::runtime_error("Invalid padding");
+        }
+    }
+    memcpy(output, block, 16 - padValue);
+    return 16 - padValue;
+}
+
+//-------------XTSģʽ--------------
+
+// XTS һδķҲһμܳʼֵ
+static const size_t kXtsBatchBlocks = 256;
+
+// 64λСд
+static inline void store_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+// ֵ 128 λСһλƳλ x^7 + x^2 + x + 1 ֽ
+//  64 λ벿ƣͰ벿Ľλλķɷλõ
+static inline __m128i xts_mul_alpha(__m128i t) {
+    __m128i carry = _mm_shuffle_epi32(_mm_srai_epi32(t, 31), 0x13);
+    carry = _mm_and_si128(carry, _mm_set_epi32(0, 1, 0, 0x87));
+    return _mm_xor_si128(_mm_add_epi64(t, t), carry);
+}
+
+// 飺output = E(input ^ t) ^ tʱΪ D
+static inline void xts_crypt_block(const SM4Key& dataKey, bool decrypt, __m128i t,
+    const uint8_t* input, uint8_t* output)
+{
+    uint8_t block[16];
+    _mm_storeu_si128((__m128i*)block, _mm_xor_si128(_mm_loadu_si128((const __m128i*)input), t));
+    if (decrypt) dataKey.decryptBlock(block, block);
+    else dataKey.encryptBlock(block, block);
+    _mm_storeu_si128((__m128i*)output, _mm_xor_si128(_mm_loadu_si128((const __m128i*)block), t));
+}
+
+// 飺ÿһƳֵöں˼ӽܣһ
+// tweak ΪһĵֵʱΪһĵֵ
+static void xts_crypt_blocks(const SM4Key& dataKey, bool decrypt, __m128i& tweak,
+    const uint8_t* input, size_t blocks, uint8_t* output)
+{
+    alignas(64) uint8_t tweaks[kXtsBatchBlocks * 16];
+    while (blocks > 0) {
+        size_t n = std::min(blocks, kXtsBatchBlocks);
+        for (size_t i = 0; i < n; i++) {
+            __m128i x = _mm_loadu_si128((const __m128i*)(input + i * 16));
+            _mm_store_si128((__m128i*)(tweaks + i * 16), tweak);
+            _mm_storeu_si128((__m128i*)(output + i * 16), _mm_xor_si128(x, tweak));
+            tweak = xts_mul_alpha(tweak);
+        }
+        if (decrypt) dataKey.decryptBlocks(output, output, n);
+        else dataKey.encryptBlocks(output, output, n);
+        xor_bytes(output, output, tweaks, n * 16);
+
+        input += n * 16;
+        output += n * 16;
+        blocks -= n;
+    }
+}
+
+// һݵԪT Ϊܺĳʼֵ
+// length  16 ıʱm Ϊһ飬β r ֽڣ
+//   ܣCC = E(P[m])  T[m]C[m + 1] = CC ǰ r ֽڣC[m] = E(P[m + 1] || CC ĺ 16 - r ֽ)  T[m + 1]
+//   ʱֵʹ˳෴
+static void xts_crypt_unit(const SM4Key& dataKey, bool decrypt, const uint8_t* T,
+    const uint8_t* input, size_t length, uint8_t* output)
+{
+    __m128i tweak = _mm_loadu_si128((const __m128i*)T);
+    size_t tail = length % 16;
+    size_t blocks = length / 16 - (tail ? 1 : 0);
+    xts_crypt_blocks(dataKey, decrypt, tweak, input, blocks, output);
+    if (tail == 0) return;
+
+    input += blocks * 16;
+    output += blocks * 16;
+    __m128i first = tweak;
+    __m128i second = xts_mul_alpha(tweak);
+    if (decrypt) std::swap(first, second);
+
+    uint8_t cc[16], pp[16];
+    xts_crypt_block(dataKey, decrypt, first, input, cc);
+    memcpy(pp, input + 16, tail);
+    memcpy(pp + tail, cc + tail, 16 - tail);
+    memcpy(output + 16, cc, tail);
+    xts_crypt_block(dataKey, decrypt, second, pp, output);
+}
+
+static void xts_crypt(const SM4Key& dataKey, const SM4Key& tweakKey, bool decrypt,
+    const uint8_t* tweak, const uint8_t* input, size_t length, uint8_t* output)
+{
+    if (!tweak || !input || !output || length < 16) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    uint8_t T[16];
+    tweakKey.encryptBlock(tweak, T);
+    xts_crypt_unit(dataKey, decrypt, T, input, length, output);
+}
+
+// зָ̳߳أ
+// ÿ߳һĳʼֵһζں˵ü
+static void xts_crypt_sectors(const SM4Key& dataKey, const SM4Key& tweakKey, bool decrypt,
+    uint64_t sector, size_t sectorSize,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads)
+{
+    if (length == 0) return;
+    if (!input || !output || sectorSize < 16 || length % sectorSize != 0) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    size_t count = length / sectorSize;
+
+    auto run = [&](size_t begin, size_t end) {
+        alignas(64) uint8_t T[kXtsBatchBlocks * 16];
+        while (begin < end) {
+            size_t n = std::min(end - begin, kXtsBatchBlocks);
+            for (size_t i = 0; i < n; i++) {
+                uint64_t number = sector + begin + i;
+                store_le64(T + i * 16, number);
+                store_le64(T + i * 16 + 8, number < sector ? 1 : 0);
             }
-            galois_mult(X.data(), H, X.data());
+            tweakKey.encryptBlocks(T, T, n);
+            for (size_t i = 0; i < n; i++) {
+                size_t offset = (begin + i) * sectorSize;
+                xts_crypt_unit(dataKey, decrypt, T + i * 16, input + offset, sectorSize, output + offset);
+            }
+            begin += n;
         }
-        };
+    };
+
+    size_t tasks = std::min(parallel_tasks(length, threads), count);
+    if (tasks <= 1) {
+        run(0, count);
+        return;
+    }
+    size_t sectorsPerTask = (count + tasks - 1) / tasks;
+    ThreadPool::shared().parallelFor(tasks, [&](size_t t) {
+        size_t begin = t * sectorsPerTask;
+        if (begin >= count) return;
+        run(begin, std::min(count, begin + sectorsPerTask));
+    });
+}
 
-    ghash_update(aad);
-    ghash_update(ciphertext);
+void sm4_xts_encrypt(const SM4Key& dataKey, const SM4Key& tweakKey, const uint8_t* tweak,
+    const uint8_t* input, size_t length, uint8_t* output)
+{
+    SM4_STAT_BYTES(MODE_XTS, ENCRYPT, length);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+    xts_crypt(dataKey, tweakKey, false, tweak, input, length, output);
+}
+
+void sm4_xts_decrypt(const SM4Key& dataKey, const SM4Key& tweakKey, const uint8_t* tweak,
+    const uint8_t* input, size_t length, uint8_t* output)
+{
+    SM4_STAT_BYTES(MODE_XTS, DECRYPT, length);
+    SM4_STAT_CYCLES(CALL_DECRYPT);
+    xts_crypt(dataKey, tweakKey, true, tweak, input, length, output);
+}
+
+void sm4_xts_encrypt_sectors(const SM4Key& dataKey, const SM4Key& tweakKey,
+    uint64_t sector, size_t sectorSize,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads)
+{
+    SM4_STAT_BYTES(MODE_XTS, ENCRYPT, length);
+    SM4_STAT_CYCLES(CALL_ENCRYPT);
+    xts_crypt_sectors(dataKey, tweakKey, false, sector, sectorSize, input, length, output, threads);
+}
+
+void sm4_xts_decrypt_sectors(const SM4Key& dataKey, const SM4Key& tweakKey,
+    uint64_t sector, size_t sectorSize,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads)
+{
+    SM4_STAT_BYTES(MODE_XTS, DECRYPT, length);
+    SM4_STAT_CYCLES(CALL_DECRYPT);
+    xts_crypt_sectors(dataKey, tweakKey, true, sector, sectorSize, input, length, output, threads);
+}
 
+//-------------SM4-GCMģʽ--------------
+
+// GCM һδķܡ GHASH һɣ
+//  L1 ֻһ
+static const size_t kGcmBatchBlocks = 64;
+
+bool sm4internal::tag_equal(const uint8_t* a, const uint8_t* b, size_t length) {
+    uint8_t diff = 0;
+    for (size_t i = 0; i < length; i++) {
+        diff |= a[i] ^ b[i];
+    }
+    return diff == 0;
+}
+
+// J0 = IV || 0^31 || 196 λ IV J0 = GHASH(IV || 0^s || [len(IV)]64)
+static void gcm_j0(const GHashKey& ghashKey, const uint8_t* iv, size_t iv_len, uint8_t* J0) {
+    if (iv_len == 12) {
+        memcpy(J0, iv, 12);
+        store_be32(J0 + 12, 1);
+        return;
+    }
+    memset(J0, 0, 16);
+    ghashKey.update(J0, iv, iv_len);
     uint8_t lenBlock[16] = { 0 };
-    uint64_t aad_bits = aad.size() * 8;
-    uint64_t ct_bits = ciphertext.size() * 8;
-    for (int i = 0; i < 8; i++) lenBlock[7 - i] = (aad_bits >> (i * 8)) & 0xFF;
-    for (int i = 0; i < 8; i++) lenBlock[15 - i] = (ct_bits >> (i * 8)) & 0xFF;
+    store_be64(lenBlock + 8, uint64_t(iv_len) * 8);
+    ghashKey.update(J0, lenBlock, 16);
+}
 
-    for (int j = 0; j < 16; j++) {
-        X[j] ^= lenBlock[j];
+void SM4Key::gcmJ0(const uint8_t* iv, size_t iv_len, uint8_t* J0) const {
+    if (!iv || iv_len == 0) {
+        throw std::invalid_argument("Invalid input parameters");
     }
-    galois_mult(X.data(), H, X.data());
+    gcm_j0(ghash, iv, iv_len, J0);
+}
+
+// Ӽֵ counter ʼݲս GHASH ״̬ Xcounter ʱָһֵ
+// Ϊ J0 ǰ 12 ֽ || counterinc32 2^32 ƣ
+// ÿһöں˼ܼʱ GHASH
+// ʱȶ GHASH  input  output ͬ
+// length  16 ıʱһ鲹 GHASHֻܳϢĩβ
+template <typename BlocksFn>
+static void gcm_ctr_ghash(
+    BlocksFn encryptBlocks, const GHashKey& ghashKey, bool decrypt,
+    const uint8_t* J0, uint32_t& counter, uint8_t* X,
+    const uint8_t* input, size_t length, uint8_t* output)
+{
+    alignas(64) uint8_t keystream[kGcmBatchBlocks * 16];
+    for (size_t done = 0; done < length; ) {
+        size_t bytes = std::min(length - done, kGcmBatchBlocks * 16);
+        size_t blocks = (bytes + 15) / 16;
+        for (size_t i = 0; i < blocks; i++) {
+            memcpy(keystream + i * 16, J0, 12);
+            store_be32(keystream + i * 16 + 12, counter++);
+        }
+        encryptBlocks(keystream, keystream, blocks);
 
-    memcpy(output, X.data(), 16);
+        if (decrypt) ghashKey.update(X, input + done, bytes);
+        xor_bytes(output + done, input + done, keystream, bytes);
+        if (!decrypt) ghashKey.update(X, output + done, bytes);
+        done += bytes;
+    }
 }
 
-// Ӽ
-void increment_counter(uint8_t* counter) {
-    for (int i = 15; i >= 12; i--) {
-        if (++counter[i]) break;
+// ̰߳汾ݰгɶΣÿδԼļƫƿʼܣ
+// ״̬ GHASH GHASH ǹ H Ķʽֵ
+// ˳ϲɣX = X * H^n ^ Yn ΪöεķY Ϊöε GHASH
+template <typename BlocksFn>
+static void gcm_ctr_ghash_parallel(
+    BlocksFn encryptBlocks, const GHashKey& ghashKey, bool decrypt,
+    const uint8_t* J0, uint32_t& counter, uint8_t* X,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads)
+{
+    size_t tasks = parallel_tasks(length, threads);
+    if (tasks == 1) {
+        gcm_ctr_ghash(encryptBlocks, ghashKey, decrypt, J0, counter, X, input, length, output);
+        return;
+    }
+
+    size_t blockCount = (length + 15) / 16;
+    size_t blocksPerTask = (blockCount + tasks - 1) / tasks;
+    tasks = (blockCount + blocksPerTask - 1) / blocksPerTask;
+    std::vector<uint8_t> partial(tasks * 16, 0);
+    uint32_t first = counter;
+
+    ThreadPool::shared().parallelFor(tasks, [&](size_t t) {
+        size_t begin = t * blocksPerTask * 16;
+        size_t bytes = std::min(length - begin, blocksPerTask * 16);
+        uint32_t ctr = first + static_cast<uint32_t>(t * blocksPerTask);
+        gcm_ctr_ghash(encryptBlocks, ghashKey, decrypt, J0, ctr, partial.data() + t * 16,
+            input + begin, bytes, output + begin);
+    });
+
+    uint8_t Hn[16], Hlast[16];
+    size_t lastBlocks = blockCount - (tasks - 1) * blocksPerTask;
+    ghashKey.power(blocksPerTask, Hn);
+    ghashKey.power(lastBlocks, Hlast);
+    for (size_t t = 0; t < tasks; t++) {
+        ghashKey.multiply(X, t + 1 < tasks ? Hn : Hlast);
+        xor_bytes(X, X, partial.data() + t * 16, 16);
     }
+    counter = first + static_cast<uint32_t>(blockCount);
+}
+
+// ճȷ飬ǩ = GHASH ^ E(J0)
+template <typename BlocksFn>
+static void gcm_tag(
+    BlocksFn encryptBlocks, const GHashKey& ghashKey,
+    const uint8_t* J0, uint8_t* X, uint64_t aad_len, uint64_t length, uint8_t* tag)
+{
+    uint8_t lenBlock[16];
+    store_be64(lenBlock, aad_len * 8);
+    store_be64(lenBlock + 8, length * 8);
+    ghashKey.update(X, lenBlock, 16);
+
+    uint8_t EkJ0[16];
+    encryptBlocks(J0, EkJ0, 1);
+    xor_bytes(tag, X, EkJ0, 16);
+}
+
+void sm4internal::gcm_counter(const uint8_t* J0, uint64_t block, uint8_t* counter) {
+    memcpy(counter, J0, 12);
+    store_be32(counter + 12, load_be32(J0 + 12) + 1 + static_cast<uint32_t>(block));
 }
 
+void sm4internal::gcm_finish(const SM4Key& key, const uint8_t* J0, uint8_t* X,
+    uint64_t aad_len, uint64_t length, uint8_t* tag)
+{
+    gcm_tag([&](const uint8_t* in, uint8_t* out, size_t n) { key.encryptBlocks(in, out, n); },
+        key.gcmHash(), J0, X, aad_len, length, tag);
+}
+
+bool sm4internal::gcm_verify(const SM4Key& key, const uint8_t* J0, uint8_t* X,
+    uint64_t aad_len, uint64_t length, const uint8_t* tag, size_t tag_len)
+{
+    uint8_t computed[16];
+    gcm_finish(key, J0, X, aad_len, length, computed);
+    if (tag_equal(computed, tag, tag_len)) return true;
+    SM4_STAT_TAG_FAILURE();
+    return false;
+}
+
+// GCM֤ NIST SP 800-38D
+// ݷʹ inc32(J0), inc32(inc32(J0)), ...ǩ = GHASH ^ E(J0)
+// threads Ϊ 0 ʱԶǷ̣߳뵥߳λͬ
+template <typename BlocksFn>
+static void gcm_crypt(
+    BlocksFn encryptBlocks, const GHashKey& ghashKey, bool decrypt,
+    const uint8_t* input, size_t length,
+    const uint8_t* aad, size_t aad_len,
+    const uint8_t* J0,
+    uint8_t* output, uint8_t* tag, unsigned threads)
+{
+    uint8_t X[16] = { 0 };
+    ghashKey.update(X, aad, aad_len);
+
+    uint32_t counter = load_be32(J0 + 12) + 1;
+    gcm_ctr_ghash_parallel(encryptBlocks, ghashKey, decrypt, J0, counter, X, input, length, output, threads);
+    gcm_tag(encryptBlocks, ghashKey, J0, X, aad_len, length, tag);
+}
 
 // GCM
 bool SM4::sm4_gcm_encrypt(
@@ -580,46 +1559,22 @@ bool SM4::sm4_gcm_encrypt(
     uint8_t* ciphertext,
     uint8_t* tag, int tag_len)
 {
-    if (iv_len != 12 || tag_len != 16) return false;
+    if (iv_len != 12 || tag_len != 16 || plaintext_len < 0 || aad_len < 0) return false;
+    SM4_STAT_BYTES(MODE_GCM, ENCRYPT, plaintext_len);
+    SM4_STAT_CYCLES(CALL_GCM_ENCRYPT);
 
     uint8_t H[16] = { 0 };
     sm4.encryptBlock(H, H);  // H = E_K(0)
-
+    GHashKey ghashKey(H);
     uint8_t J0[16];
-    memcpy(J0, iv, 12);
-    J0[12] = J0[13] = J0[14] = 0;
-    J0[15] = 1;
-
-    uint8_t counter[16];
-    memcpy(counter, J0, 16);
-    std::vector<uint8_t> ct;
-
-    for (int i = 0; i < plaintext_len; i += 16) {
-        uint8_t keystream[16] = { 0 };
-        sm4.encryptBlock(counter, keystream);
-        increment_counter(counter);
-
-        int len = std::min(16, plaintext_len - i);
-        for (int j = 0; j < len; j++) {
-            ciphertext[i + j] = plaintext[i + j] ^ keystream[j];
-        }
-        ct.insert(ct.end(), &ciphertext[i], &ciphertext[i + len]);
-    }
-
-    uint8_t S[16];
-    ghash(H, std::vector<uint8_t>(aad, aad + aad_len), ct, S);
-
-    uint8_t EkJ0[16];
-    sm4.encryptBlock(J0, EkJ0);
-
-    for (int i = 0; i < 16; i++) {
-        tag[i] = S[i] ^ EkJ0[i];
-    }
+    gcm_j0(ghashKey, iv, 12, J0);
 
+    gcm_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { cryptBlocks(sm4.kernel, sm4.useTable, sm4.rk, in, out, n); },
+        ghashKey, false, plaintext, plaintext_len, aad, aad_len, J0, ciphertext, tag, 0);
     return true;
 }
 
-// GCM
+// GCMܣǩƥʱ
 bool SM4::sm4_gcm_decrypt(
     SM4& sm4,
     const uint8_t* ciphertext, int ciphertext_len,
@@ -628,42 +1583,373 @@ bool SM4::sm4_gcm_decrypt(
     const uint8_t* tag, int tag_len,
     uint8_t* plaintext)
 {
-    if (iv_len != 12 || tag_len != 16) return false;
+    if (iv_len != 12 || tag_len != 16 || ciphertext_len < 0 || aad_len < 0) return false;
+    SM4_STAT_BYTES(MODE_GCM, DECRYPT, ciphertext_len);
+    SM4_STAT_CYCLES(CALL_GCM_DECRYPT);
 
     uint8_t H[16] = { 0 };
     sm4.encryptBlock(H, H);  // H = E_K(0)
+    GHashKey ghashKey(H);
+    uint8_t J0[16];
+    gcm_j0(ghashKey, iv, 12, J0);
+
+    uint8_t computedTag[16];
+    gcm_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { cryptBlocks(sm4.kernel, sm4.useTable, sm4.rk, in, out, n); },
+        ghashKey, true, ciphertext, ciphertext_len, aad, aad_len, J0, plaintext, computedTag, 0);
+
+    if (!tag_equal(computedTag, tag, 16)) {
+        SM4_STAT_TAG_FAILURE();
+        if (ciphertext_len > 0) memset(plaintext, 0, ciphertext_len);
+        return false;
+    }
+    return true;
+}
+
+// GCMܣԿ
+bool sm4_gcm_encrypt(
+    const SM4Key& key,
+    const uint8_t* plaintext, size_t plaintext_len,
+    const uint8_t* aad, size_t aad_len,
+    const uint8_t* iv, size_t iv_len,
+    uint8_t* ciphertext,
+    uint8_t* tag, size_t tag_len,
+    unsigned threads)
+{
+    if (!iv || iv_len == 0 || tag_len != 16 || plaintext_len > kGcmMaxBytes) return false;
+    SM4_STAT_BYTES(MODE_GCM, ENCRYPT, plaintext_len);
+    SM4_STAT_CYCLES(CALL_GCM_ENCRYPT);
 
     uint8_t J0[16];
-    memcpy(J0, iv, 12);
-    J0[12] = J0[13] = J0[14] = 0;
-    J0[15] = 1;
+    key.gcmJ0(iv, iv_len, J0);
+    gcm_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { key.encryptBlocks(in, out, n); },
+        key.gcmHash(), false, plaintext, plaintext_len, aad, aad_len, J0, ciphertext, tag, threads);
+    return true;
+}
+
+// GCMܣԿǩƥʱ
+bool sm4_gcm_decrypt(
+    const SM4Key& key,
+    const uint8_t* ciphertext, size_t ciphertext_len,
+    const uint8_t* aad, size_t aad_len,
+    const uint8_t* iv, size_t iv_len,
+    const uint8_t* tag, size_t tag_len,
+    uint8_t* plaintext,
+    unsigned threads)
+{
+    if (!iv || iv_len == 0 || tag_len != 16 || ciphertext_len > kGcmMaxBytes) return false;
+    SM4_STAT_BYTES(MODE_GCM, DECRYPT, ciphertext_len);
+    SM4_STAT_CYCLES(CALL_GCM_DECRYPT);
+
+    uint8_t J0[16];
+    key.gcmJ0(iv, iv_len, J0);
+    uint8_t computedTag[16];
+    gcm_crypt([&](const uint8_t* in, uint8_t* out, size_t n) { key.encryptBlocks(in, out, n); },
+        key.gcmHash(), true, ciphertext, ciphertext_len, aad, aad_len, J0, plaintext, computedTag, threads);
+
+    if (!tag_equal(computedTag, tag, 16)) {
+        SM4_STAT_TAG_FAILURE();
+        if (ciphertext_len > 0) memset(plaintext, 0, ciphertext_len);
+        return false;
+    }
+    return true;
+}
+
+//-------------GCM--------------
+
+// һζں˵ôķÿĵ J0
+static const size_t kGcmBurstBlocks = 256;
+
+// βʱǩʱȽϱǩʧʱ
+static bool gcm_packet_finish(const SM4GcmPacket& packet, bool decrypt, const uint8_t* tag) {
+    if (!decrypt) {
+        memcpy(packet.tag, tag, 16);
+        return true;
+    }
+    if (tag_equal(tag, packet.tag, 16)) return true;
+    SM4_STAT_TAG_FAILURE();
+    if (packet.length > 0) memset(packet.output, 0, packet.length);
+    return false;
+}
+
+// дһαģ֤ʧܵĸ
+// ıĴ kGcmBurstBlocks Ϊһ飺ĵ J0 ͼ飬
+// һμܺ keystream ÿռ 1 + ceil(length / 16) 飬һΪ E(J0)
+// ķŲʱͨϢ
+static size_t gcm_crypt_packets(const SM4Key& key, bool decrypt,
+    const SM4GcmPacket* packets, size_t count, bool* results)
+{
+    const GHashKey& ghashKey = key.gcmHash();
+    auto encryptBlocks = [&](const uint8_t* in, uint8_t* out, size_t n) { key.encryptBlocks(in, out, n); };
+    alignas(64) uint8_t keystream[kGcmBurstBlocks * 16];
+    // һ kGcmBurstBlocks - 1 ݷ飬ټ AAD β볤ȷ
+    alignas(64) uint8_t ghashInput[(kGcmBurstBlocks + 1) * 16];
+    size_t failures = 0;
+
+    size_t i = 0;
+    while (i < count) {
+        size_t end = i;
+        size_t blocks = 0;
+        while (end < count) {
+            const SM4GcmPacket& packet = packets[end];
+            size_t n = 1 + (packet.length + 15) / 16;
+            if (blocks + n > kGcmBurstBlocks) break;
+
+            uint8_t* J0 = keystream + blocks * 16;
+            key.gcmJ0(packet.iv, packet.iv_len, J0);
+            uint32_t counter = load_be32(J0 + 12);
+            for (size_t b = 1; b < n; b++) {
+                memcpy(J0 + b * 16, J0, 12);
+                store_be32(J0 + b * 16 + 12, ++counter);
+            }
+            blocks += n;
+            end++;
+        }
 
-    uint8_t counter[16];
-    memcpy(counter, J0, 16);
-    std::vector<uint8_t> pt;
+        if (end == i) {
+            const SM4GcmPacket& packet = packets[i];
+            uint8_t J0[16], tag[16];
+            key.gcmJ0(packet.iv, packet.iv_len, J0);
+            gcm_crypt(encryptBlocks, ghashKey, decrypt, packet.input, packet.length,
+                packet.aad, packet.aad_len, J0, packet.output, tag, 1);
+            bool ok = gcm_packet_finish(packet, decrypt, tag);
+            if (results) results[i] = ok;
+            failures += !ok;
+            i++;
+            continue;
+        }
 
-    for (int i = 0; i < ciphertext_len; i += 16) {
-        uint8_t keystream[16] = { 0 };
-        sm4.encryptBlock(counter, keystream);
-        increment_counter(counter);
+        encryptBlocks(keystream, keystream, blocks);
+
+        // Сĵ GHASH ҪÿεĩβĹԼϣAAD һ顢
+        // 볤ȷƴķһգÿֻԼһ
+        const uint8_t* EkJ0 = keystream;
+        for (; i < end; i++) {
+            const SM4GcmPacket& packet = packets[i];
+            uint8_t X[16] = { 0 };
+            size_t aadFull = packet.aad_len - packet.aad_len % 16;
+            ghashKey.update(X, packet.aad, aadFull);
+
+            uint8_t* p = ghashInput;
+            if (packet.aad_len > aadFull) {
+                memset(p, 0, 16);
+                memcpy(p, packet.aad + aadFull, packet.aad_len - aadFull);
+                p += 16;
+            }
+            size_t padded = (packet.length + 15) / 16 * 16;
+            if (padded > 0) memset(p + padded - 16, 0, 16);
+            if (decrypt) memcpy(p, packet.input, packet.length);
+            xor_bytes(packet.output, packet.input, EkJ0 + 16, packet.length);
+            if (!decrypt) memcpy(p, packet.output, packet.length);
+            p += padded;
+            store_be64(p, uint64_t(packet.aad_len) * 8);
+            store_be64(p + 8, uint64_t(packet.length) * 8);
+            p += 16;
+            ghashKey.update(X, ghashInput, p - ghashInput);
+
+            uint8_t tag[16];
+            xor_bytes(tag, X, EkJ0, 16);
+
+            bool ok = gcm_packet_finish(packet, decrypt, tag);
+            if (results) results[i] = ok;
+            failures += !ok;
+            EkJ0 += (1 + (packet.length + 15) / 16) * 16;
+        }
+    }
+    return failures;
+}
 
-        int len = std::min(16, ciphertext_len - i);
-        for (int j = 0; j < len; j++) {
-            plaintext[i + j] = ciphertext[i + j] ^ keystream[j];
+// ıзָ̳߳
+static size_t gcm_batch(const SM4Key& key, bool decrypt,
+    const SM4GcmPacket* packets, size_t count, bool* results, unsigned threads)
+{
+    if (count == 0) return 0;
+    if (!packets) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    size_t totalLength = 0;
+    for (size_t i = 0; i < count; i++) {
+        const SM4GcmPacket& packet = packets[i];
+        if (!packet.iv || packet.iv_len == 0 || !packet.tag || packet.length > kGcmMaxBytes ||
+            (packet.aad_len > 0 && !packet.aad) ||
+            (packet.length > 0 && (!packet.input || !packet.output))) {
+            throw std::invalid_argument("Invalid input parameters");
         }
-        pt.insert(pt.end(), &plaintext[i], &plaintext[i + len]);
+        totalLength += packet.length;
     }
+    SM4_STAT_BYTES(MODE_GCM, decrypt ? DECRYPT : ENCRYPT, totalLength);
 
-    uint8_t S[16];
-    ghash(H, std::vector<uint8_t>(aad, aad + aad_len), std::vector<uint8_t>(ciphertext, ciphertext + ciphertext_len), S);
+    size_t tasks = std::min(parallel_tasks(totalLength, threads), count);
+    if (tasks <= 1) {
+        return gcm_crypt_packets(key, decrypt, packets, count, results);
+    }
+    size_t packetsPerTask = (count + tasks - 1) / tasks;
+    std::atomic<size_t> failures(0);
+    ThreadPool::shared().parallelFor(tasks, [&](size_t t) {
+        size_t begin = t * packetsPerTask;
+        if (begin >= count) return;
+        size_t n = std::min(count - begin, packetsPerTask);
+        failures += gcm_crypt_packets(key, decrypt, packets + begin, n, results ? results + begin : nullptr);
+    });
+    return failures;
+}
 
-    uint8_t EkJ0[16];
-    sm4.encryptBlock(J0, EkJ0);
+void sm4_gcm_seal_batch(const SM4Key& key, const SM4GcmPacket* packets, size_t count, unsigned threads) {
+    gcm_batch(key, false, packets, count, nullptr, threads);
+}
 
-    uint8_t computedTag[16];
-    for (int i = 0; i < 16; i++) {
-        computedTag[i] = S[i] ^ EkJ0[i];
+bool sm4_gcm_open_batch(const SM4Key& key, const SM4GcmPacket* packets, size_t count,
+    bool* results, unsigned threads)
+{
+    return gcm_batch(key, true, packets, count, results, threads) == 0;
+}
+
+//-------------ʽGCM--------------
+
+SM4GcmContext::SM4GcmContext(const SM4Key& key)
+    : key(&key), counter(0), bufferLength(0), keystreamUsed(16),
+      aadLength(0), dataLength(0), dataStarted(false), encrypting(true), active(false)
+{
+    memset(J0, 0, 16);
+    memset(X, 0, 16);
+}
+
+void SM4GcmContext::requireActive() const {
+    if (!active) {
+        throw std::runtime_error("GCM message not started, call init with a new IV");
     }
+}
 
-    return memcmp(computedTag, tag, 16) == 0;
-}
\ No newline at end of file
+void SM4GcmContext::init(const uint8_t* iv, size_t iv_len, bool encrypt) {
+    key->gcmJ0(iv, iv_len, J0);
+    counter = load_be32(J0 + 12) + 1;
+    memset(X, 0, 16);
+    bufferLength = 0;
+    keystreamUsed = 16;
+    aadLength = 0;
+    dataLength = 0;
+    dataStarted = false;
+    encrypting = encrypt;
+    active = true;
+}
+
+void SM4GcmContext::setAAD(const uint8_t* aad, size_t aad_len) {
+    requireActive();
+    if (aad_len == 0) return;
+    if (!aad) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    if (dataStarted) {
+        throw std::runtime_error("AAD must be set before data");
+    }
+    aadLength += aad_len;
+    const GHashKey& ghashKey = key->gcmHash();
+
+    // ȴϴʣµķ飬գµһ
+    if (bufferLength > 0) {
+        size_t n = std::min(16 - bufferLength, aad_len);
+        memcpy(buffer + bufferLength, aad, n);
+        bufferLength += n;
+        aad += n;
+        aad_len -= n;
+        if (bufferLength < 16) return;
+        ghashKey.update(X, buffer, 16);
+        bufferLength = 0;
+    }
+    size_t full = aad_len - aad_len % 16;
+    ghashKey.update(X, aad, full);
+    memcpy(buffer, aad + full, aad_len - full);
+    bufferLength = aad_len - full;
+}
+
+void SM4GcmContext::update(const uint8_t* input, size_t length, uint8_t* output) {
+    requireActive();
+    if (length == 0) return;
+    if (!input || !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    if (dataLength + length > kGcmMaxBytes) {
+        throw std::runtime_error("GCM message too long");
+    }
+    SM4_STAT_BYTES(MODE_GCM, encrypting ? ENCRYPT : DECRYPT, length);
+    auto encryptBlocks = [&](const uint8_t* in, uint8_t* out, size_t n) { key->encryptBlocks(in, out, n); };
+    const GHashKey& ghashKey = key->gcmHash();
+
+    // AAD һ鲹
+    if (!dataStarted) {
+        if (bufferLength > 0) {
+            ghashKey.update(X, buffer, bufferLength);
+            bufferLength = 0;
+        }
+        dataStarted = true;
+    }
+    dataLength += length;
+
+    // һʣԿӦܽ buffer
+    while (length > 0 && keystreamUsed < 16) {
+        uint8_t c = encrypting ? (*input ^ keystream[keystreamUsed]) : *input;
+        *output++ = *input++ ^ keystream[keystreamUsed++];
+        buffer[bufferLength++] = c;
+        length--;
+    }
+    if (bufferLength == 16) {
+        ghashKey.update(X, buffer, 16);
+        bufferLength = 0;
+    }
+
+    // 鲿
+    size_t full = length - length % 16;
+    gcm_ctr_ghash_parallel(encryptBlocks, ghashKey, !encrypting, J0, counter, X, input, full, output, 0);
+    input += full;
+    output += full;
+    length -= full;
+
+    // һβʣԿһε
+    if (length > 0) {
+        memcpy(keystream, J0, 12);
+        store_be32(keystream + 12, counter++);
+        key->encryptBlock(keystream, keystream);
+        for (size_t i = 0; i < length; i++) {
+            uint8_t c = encrypting ? (input[i] ^ keystream[i]) : input[i];
+            output[i] = input[i] ^ keystream[i];
+            buffer[i] = c;
+        }
+        bufferLength = length;
+        keystreamUsed = length;
+    }
+}
+
+void SM4GcmContext::computeTag(uint8_t* tag) {
+    const GHashKey& ghashKey = key->gcmHash();
+
+    // һ飨ݻûʱ AAD
+    if (bufferLength > 0) {
+        ghashKey.update(X, buffer, bufferLength);
+        bufferLength = 0;
+    }
+    gcm_tag([&](const uint8_t* in, uint8_t* out, size_t n) { key->encryptBlocks(in, out, n); },
+        ghashKey, J0, X, aadLength, dataLength, tag);
+}
+
+void SM4GcmContext::finish(uint8_t* tag, size_t tag_len) {
+    requireActive();
+    if (!tag || tag_len < MIN_TAG_LENGTH || tag_len > 16) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    uint8_t fullTag[16];
+    computeTag(fullTag);
+    active = false;
+    memcpy(tag, fullTag, tag_len);
+}
+
+bool SM4GcmContext::verify(const uint8_t* tag, size_t tag_len) {
+    requireActive();
+    if (!tag || tag_len < MIN_TAG_LENGTH || tag_len > 16) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    uint8_t fullTag[16];
+    computeTag(fullTag);
+    active = false;
+    if (tag_equal(fullTag, tag, tag_len)) return true;
+    SM4_STAT_TAG_FAILURE();
+    return false;
+}
@@ -3,6 +3,14 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <array>
+#include "ghash.h"
+
+namespace sm4simd { struct Kernel; }
+
+class SM4Key;
+struct SM4CbcJob;
+void sm4_cbc_encrypt_multi(const SM4CbcJob* jobs, size_t count, unsigned threads);
 
 // SM4㷨ʵ
 class SM4 {
@@ -10,11 +18,23 @@ public:
     // ģʽ
     enum Mode {
         ECB,    // ECBģʽ
-        CBC     // CBCģʽ
+        CBC,    // CBCģʽ
+        CTR     // CTRģʽ128λ˼䣩
     };
 
-    // 캯Կ
-    SM4(const uint8_t* key, Mode mode = ECB);
+    // ʵ֣ˣAUTO ʱ cpuid ѡʵ
+    enum Backend {
+        AUTO,
+        REFERENCE,  //  F()/T()
+        TTABLE,     // T
+        AVX2,       // AVX2 
+        AVX512,     // AVX-512 
+        AESNI,      // AES-NI  S 
+        GFNI        // GF2P8AFFINEQB  S 
+    };
+
+    // 캯Կָĺ˵ǰ CPU ֧ʱ׳쳣
+    SM4(const uint8_t* key, Mode mode = ECB, Backend backend = AUTO);
 
     // 
     ~SM4() = default;
@@ -34,19 +54,8 @@ public:
     // ܺؽܺݳ
     int decrypt(const uint8_t* ciphertext, int length, uint8_t* plaintext);
 
-    // ԤTã
-    uint32_t T0[256];
-    uint32_t T1[256];
-    uint32_t T2[256];
-    uint32_t T3[256];
-    uint32_t T0_prime[256];
-    uint32_t T1_prime[256];
-    uint32_t T2_prime[256];
-    uint32_t T3_prime[256];
-
-    //ʼ
-    void SM4TableInitializer();
-
+    // ǰʹõĺ
+    const char* backendName() const;
 
     //simd Ż
     void encryptBlocksAVX2(const uint8_t* inputs, uint8_t* outputs, int blockCount);
@@ -93,42 +102,355 @@ private:
     // ģʽ
     Mode mode;
 
-    // Կչ
-    void keyExpansion(const uint8_t* key);
+    // ںˣnullptr ʾ鴦
+    const sm4simd::Kernel* kernel;
+
+    // 鴦ʱǷTREFERENCE ʹ F()/T()
+    bool useTable;
+
+    // ԤTãɣʵ
+    // Tn[i] = L(Sbox[i] << (24 - 8n))Tn_prime ͬʹ L'
+    static const std::array<uint32_t, 256> T0;
+    static const std::array<uint32_t, 256> T1;
+    static const std::array<uint32_t, 256> T2;
+    static const std::array<uint32_t, 256> T3;
+    static const std::array<uint32_t, 256> T0_prime;
+    static const std::array<uint32_t, 256> T1_prime;
+    static const std::array<uint32_t, 256> T2_prime;
+    static const std::array<uint32_t, 256> T3_prime;
+
+    // T
+    static constexpr std::array<uint32_t, 256> makeTable(int shift, bool prime);
+
+    // ѡںˣCPU ֧ʱ׳쳣
+    static const sm4simd::Kernel* selectKernel(Backend backend);
+
+    // Կչͳƣɵ߼
+    static void keyExpansion(const uint8_t* key, bool useTable, uint32_t* rk);
+
+    // Կģʽˣ SM4Drbg ÿθڲ״̬ʱʹãͳ
+    void rekey(const uint8_t* key);
+
+    // 32ֵreverse ΪʱʹԿܣ
+    static void cryptBlock(const uint32_t* rk, bool reverse, bool useTable,
+        const uint8_t* input, uint8_t* output);
+
+    // ӽܣrk ʹ˳Уûжںʱ鴦
+    static void cryptBlocks(const sm4simd::Kernel* kernel, bool useTable, const uint32_t* rk,
+        const uint8_t* inputs, uint8_t* outputs, size_t blockCount);
 
     // ֺ
-    uint32_t F(uint32_t X0, uint32_t X1, uint32_t X2, uint32_t X3, uint32_t rk);
+    static uint32_t F(uint32_t X0, uint32_t X1, uint32_t X2, uint32_t X3, uint32_t rk);
 
     // Ա任
-    uint32_t tau(uint32_t a);
+    static uint32_t tau(uint32_t a);
 
     // Ա任L
-    uint32_t L(uint32_t b);
+    static constexpr uint32_t L(uint32_t b);
 
     // Ա任L'Կչ
-    uint32_t LPrime(uint32_t b);
+    static constexpr uint32_t LPrime(uint32_t b);
 
     // Ա任S
-    uint8_t S(uint8_t inch);
+    static uint8_t S(uint8_t inch);
 
     // 32λԱ任
-    uint32_t T(uint32_t a);
+    static uint32_t T(uint32_t a);
 
     // 32λԱ任Կչ
-    uint32_t TPrime(uint32_t a);
+    static uint32_t TPrime(uint32_t a);
+
+    // ʵֵTT'
+    static uint32_t tableT(uint32_t a);
+    static uint32_t tableTPrime(uint32_t a);
 
     // ֽת32λ޷
-    uint32_t bytesToWord(const uint8_t* bytes);
+    static uint32_t bytesToWord(const uint8_t* bytes);
 
     // 32λ޷תֽ
-    void wordToBytes(uint32_t word, uint8_t* bytes);
+    static void wordToBytes(uint32_t word, uint8_t* bytes);
+
+    friend class SM4Key;
+    friend class SM4Drbg;
+    friend void sm4_cbc_encrypt_multi(const SM4CbcJob* jobs, size_t count, unsigned threads);
+    friend void sm4_expand_keys(const uint8_t* keys, size_t count, uint32_t* rk, Backend backend);
+    friend void sm4_encrypt_lanes(const uint32_t* rk, size_t count, const uint8_t* input, uint8_t* output,
+        Backend backend);
+};
+
+// ɱԿԿԤĽԿԼ GCM ĹϣԿ
+// ֻڶ̼߳乲Ҫ
+class SM4Key {
+public:
+    explicit SM4Key(const uint8_t* key, SM4::Backend backend = SM4::AUTO);
+
+    // ӽܵ
+    void encryptBlock(const uint8_t* input, uint8_t* output) const;
+    void decryptBlock(const uint8_t* input, uint8_t* output) const;
+
+    // ӽܶݣʹöں
+    void encryptBlocks(const uint8_t* inputs, uint8_t* outputs, size_t blockCount) const;
+    void decryptBlocks(const uint8_t* inputs, uint8_t* outputs, size_t blockCount) const;
+
+    // GCM ϣԿ H = E_K(0)
+    const uint8_t* gcmH() const { return H; }
+
+    //  H Ԥ GHASH ԿH ݴα˷ʱһΣÿ nonce ֱӸ
+    const GHashKey& gcmHash() const { return ghash; }
+
+    //  IV  GCM ĳʼ J096 λ IV Ϊ IV || 0^31 || 1
+    // Ϊ GHASH(IV || 0^s || [len(IV)]64)
+    void gcmJ0(const uint8_t* iv, size_t iv_len, uint8_t* J0) const;
+
+    // ǰʹõĺ
+    const char* backendName() const;
+
+private:
+    // Կ
+    uint32_t rk[32];
+
+    // Կrk 
+    uint32_t drk[32];
+
+    // GCM ϣԿ
+    uint8_t H[16];
+
+    // GCM  GHASH Կ
+    GHashKey ghash;
+
+    // ںˣnullptr ʾ鴦
+    const sm4simd::Kernel* kernel;
+
+    // 鴦ʱǷT
+    bool useTable;
+
+    friend void sm4_cbc_encrypt_multi(const SM4CbcJob* jobs, size_t count, unsigned threads);
+};
+
+// ÿģģʽֵCBC ĵǰ IV / CTR ļ
+// Լ CTR δԿֻù SM4KeyҪԿչ
+class SM4Context {
+public:
+    SM4Context(const SM4Key& key, SM4::Mode mode, const uint8_t* iv = nullptr);
+
+    // óʼʼµ
+    void setIV(const uint8_t* iv);
+
+    // ӽݣlength Ϊ 16 ıCBC ֵڶε֮
+    void encryptBlocks(const uint8_t* input, size_t length, uint8_t* output);
+    void decryptBlocks(const uint8_t* input, size_t length, uint8_t* output);
+
+    // CTR ģʽӽⳤݣεʱϴͣµԿλü
+    void ctrCrypt(const uint8_t* input, size_t length, uint8_t* output);
+
+    // һԼӽܣȣֵصʼ IV
+    // ECB/CBC ʹ PKCS#7 䣬CTR 
+    size_t encrypt(const uint8_t* plaintext, size_t length, uint8_t* ciphertext);
+    size_t decrypt(const uint8_t* ciphertext, size_t length, uint8_t* plaintext);
+
+    // ʽӽܣinit ӳʼ IV ʼһµupdate ⳤȵݿ飬
+    // ڲֻһݣinput  output ͬ
+    // update رд output ֽ length + 15
+    // final дݲֽ 16
+    //   ʱ ECB/CBC ׷ PKCS#7 䣻ʱ update Ǳһ飬
+    //    final ܲУ䣻CTR 䣬final 
+    void init(bool encrypt);
+    size_t update(const uint8_t* input, size_t length, uint8_t* output);
+    size_t final(uint8_t* output);
+
+    // ʽӿǷʹ PKCS#7 䣨Ĭʹãرպܳ 16 ı
+    // ʱ update ٱһ飬final ʣ಻һʱ׳쳣
+    void setPadding(bool enable) { padding = enable; }
+
+private:
+    // Կ
+    const SM4Key* key;
+
+    // ģʽ
+    SM4::Mode mode;
+
+    // ʼ
+    uint8_t iv[16];
+
+    // ǰֵ
+    uint8_t chain[16];
+
+    // CTR ģʽһʣԿ
+    uint8_t keystream[16];
+    size_t keystreamUsed;
+
+    // ʽӿڣܻǽܣǷ䣬ԼδʱΪķ
+    bool encrypting;
+    bool padding;
+    uint8_t partial[16];
+    size_t partialLength;
+};
+
+// Զ̵߳ޣֽڣĬ 256KBthreads Ϊ 0 Ľӿ
+// ֻﵽ޵ϲз֣ÿ߳ٷֵô
+void sm4_set_parallel_threshold(size_t bytes);
+
+// CTR ģʽcounter Ϊʼͬinput  output ͬ
+// threads Ϊ 0 ʱԶ󻺳зָ̳߳أ
+// ÿ̴߳Լļƫƿʼֱд output ĶӦ
+void sm4_ctr_crypt(
+    const SM4Key& key, const uint8_t* counter,
+    const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads = 0);
+
+// CBC ģʽܣ P_i = D(C_i) ^ C_{i-1} νں˽ܺ
+// ٵһiv Ϊ C_0 ֮ǰֵlength Ϊ 16 ıinput  output ͬ
+// threads Ϊ 0 ʱԶ
+void sm4_cbc_decrypt(
+    const SM4Key& key, const uint8_t* iv,
+    const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads = 0);
+
+// Կչkeys Ϊ count  16 ֽԿrk  32 * count 
+// rk[r * count + i] Ϊ i Կ r ֵļԿ໺ں˵ԿУ
+// ÿ 8  16 ԿͨвչS ںʹͬʵ֣һչ
+// backend  SM4Key ָͬĺ˵ǰ CPU ֧ʱ׳쳣
+void sm4_expand_keys(const uint8_t* keys, size_t count, uint32_t* rk, SM4::Backend backend = SM4::AUTO);
+
+// Կܣ i õ i Կܣrk Ϊ sm4_expand_keys ͬһ count 
+// input  output ͬ
+void sm4_encrypt_lanes(const uint32_t* rk, size_t count, const uint8_t* input, uint8_t* output,
+    SM4::Backend backend = SM4::AUTO);
+
+// ໺ CBC ܵһ񣺶ԿIV ݣlength Ϊ 16 ı䣩
+// input  output ͬͬĻص
+struct SM4CbcJob {
+    const SM4Key* key;
+    const uint8_t* iv;
+    const uint8_t* input;
+    size_t length;
+    uint8_t* output;
+};
+
+// ໺ CBC ܣϢ CBC ǴеģѶص
+// ֯ں˵ͨУÿͨʹøԿ
+// һһϸͨthreads Ϊ 0 ʱԶ
+void sm4_cbc_encrypt_multi(const SM4CbcJob* jobs, size_t count, unsigned threads = 0);
+
+// XTS ģʽIEEE 1619dataKey ݣtweakKey ֵܵԿ벻ͬ
+// tweak Ϊ 16 ֽڵݵԪţlength  16 ֽڣ 16 ıʱŲã
+// ݵԪ֮以дһԪinput  output ͬ
+void sm4_xts_encrypt(const SM4Key& dataKey, const SM4Key& tweakKey, const uint8_t* tweak,
+    const uint8_t* input, size_t length, uint8_t* output);
+void sm4_xts_decrypt(const SM4Key& dataKey, const SM4Key& tweakKey, const uint8_t* tweak,
+    const uint8_t* input, size_t length, uint8_t* output);
+
+// ӽܣinput Ϊ sector ʼÿ sectorSize ֽڣ 16
+// ֵΪŵ 128 λС˱ʾlength  sectorSize ıthreads Ϊ 0 ʱԶ
+void sm4_xts_encrypt_sectors(const SM4Key& dataKey, const SM4Key& tweakKey,
+    uint64_t sector, size_t sectorSize,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads = 0);
+void sm4_xts_decrypt_sectors(const SM4Key& dataKey, const SM4Key& tweakKey,
+    uint64_t sector, size_t sectorSize,
+    const uint8_t* input, size_t length, uint8_t* output, unsigned threads = 0);
+
+// ʹùԿ GCM ģʽH Ԥȡ SM4Keyٰ¼
+// IV 㳤ȣ96 λ죩ǩΪ 16 ֽ
+// threads Ϊ 0 ʱԶϢи̳߳أε GHASH  H ݴκϲ
+// 뵥߳λͬ
+bool sm4_gcm_encrypt(
+    const SM4Key& key,
+    const uint8_t* plaintext, size_t plaintext_len,
+    const uint8_t* aad, size_t aad_len,
+    const uint8_t* iv, size_t iv_len,
+    uint8_t* ciphertext,
+    uint8_t* tag, size_t tag_len,
+    unsigned threads = 0);
+
+bool sm4_gcm_decrypt(
+    const SM4Key& key,
+    const uint8_t* ciphertext, size_t ciphertext_len,
+    const uint8_t* aad, size_t aad_len,
+    const uint8_t* iv, size_t iv_len,
+    const uint8_t* tag, size_t tag_len,
+    uint8_t* plaintext,
+    unsigned threads = 0);
+
+//  GCM һģiv Ϊ㳤ȣtag Ϊ 16 ֽڣseal ʱopen ʱȡ
+// input  output ͬͬĵĻص
+struct SM4GcmPacket {
+    const uint8_t* iv;
+    size_t iv_len;
+    const uint8_t* aad;
+    size_t aad_len;
+    const uint8_t* input;
+    size_t length;
+    uint8_t* output;
+    uint8_t* tag;
+};
+
+//  GCMͬһԿµĶСһδʱÿĵһζܡ
+// һͨ˷ѣѶĵ E(J0) ͼһ
+// һζں˵ȫԿthreads Ϊ 0 ʱԶ
+void sm4_gcm_seal_batch(const SM4Key& key, const SM4GcmPacket* packets, size_t count, unsigned threads = 0);
+
+//  GCM ܣresults[i] Ϊ i ĵ֤Ϊ nullptr
+// ֤ʧܵıģȫͨʱ true
+bool sm4_gcm_open_batch(const SM4Key& key, const SM4GcmPacket* packets, size_t count,
+    bool* results, unsigned threads = 0);
+
+// ʽ GCM ģڶε֮䱣 GHASH ״̬δԿ
+// ݿԷСĿ룬ڴռϢ޹
+// ÷init  setAADɶΣ֮ǰ updateɶΣ  finish /  verify
+// Լ finish/verify ֮Ĵδʼ״̬ init ĵö׳ std::runtime_error
+// Ĭϻù IV ¼
+// ʱ update  verify  true ֮ǰδ֤ܽϲʹ
+class SM4GcmContext {
+public:
+    // ǩ 12 ֽڣSP 800-38D  12~16 ֽڣ̵ıǩױα
+    static const size_t MIN_TAG_LENGTH = 12;
+
+    explicit SM4GcmContext(const SM4Key& key);
+
+    // ʼһϢIV 㳤
+    void init(const uint8_t* iv, size_t iv_len, bool encrypt);
+
+    // ׷Ӹ֤
+    void setAAD(const uint8_t* aad, size_t aad_len);
+
+    // ӽⳤȵݣinput  output ͬ
+    void update(const uint8_t* input, size_t length, uint8_t* output);
+
+    // ܽǩtag_len Ϊ 12~16ȡǩǰ tag_len ֽڣ
+    void finish(uint8_t* tag, size_t tag_len = 16);
+
+    // ܽʱȽϱǩtag_len Ϊ 12~16
+    bool verify(const uint8_t* tag, size_t tag_len = 16);
+
+private:
+    // ķ飬 16 ֽڱǩ
+    void computeTag(uint8_t* tag);
 
+    //  init  finish/verify ֮ʱ׳쳣
+    void requireActive() const;
 
+    const SM4Key* key;
 
+    // Ԥ飬Լһݷʹõļֵ
+    uint8_t J0[16];
+    uint32_t counter;
 
+    // GHASH ״̬Լδһ AAD 
+    uint8_t X[16];
+    uint8_t buffer[16];
+    size_t bufferLength;
 
+    // һʣԿ
+    uint8_t keystream[16];
+    size_t keystreamUsed;
 
+    uint64_t aadLength;
+    uint64_t dataLength;
+    bool dataStarted;
+    bool encrypting;
 
+    // init ֮finish/verify ֮ǰΪ true
+    bool active;
 };
 
 #endif // SM4_H
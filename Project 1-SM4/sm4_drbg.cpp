@@ -0,0 +1,374 @@
+#include "sm4_drbg.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/random.h>
+#else
+#include <random>
+#endif
+#if !defined(_WIN32)
+#include <pthread.h>
+#endif
+
+//-------------Դ--------------
+
+void sm4_os_entropy(uint8_t* output, size_t length) {
+#if defined(__linux__)
+    while (length > 0) {
+        ssize_t n = getrandom(output, length, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error("Entropy source failed");
+        }
+        output += n;
+        length -= static_cast<size_t>(n);
+    }
+#else
+    std::random_device rd;
+    for (size_t i = 0; i < length; i += 4) {
+        uint32_t r = rd();
+        memcpy(output + i, &r, std::min<size_t>(4, length - i));
+    }
+#endif
+}
+
+//-------------CTR_DRBG--------------
+
+// V Ϊ 128 λһ
+static inline void increment(uint8_t* V) {
+    for (int i = 15; i >= 0; i--) {
+        if (++V[i] != 0) break;
+    }
+}
+
+// ݣⱻ洢Ż
+static void secure_zero(void* p, size_t length) {
+    volatile uint8_t* q = static_cast<volatile uint8_t*>(p);
+    while (length--) *q++ = 0;
+}
+
+static const uint8_t kZeroKey[16] = { 0 };
+
+SM4Drbg::SM4Drbg(const uint8_t* personalization, size_t length) : cipher(kZeroKey) {
+    uint8_t entropy[kSeedLength];
+    sm4_os_entropy(entropy, kSeedLength);
+    memset(key, 0, 16);
+    memset(V, 0, 16);
+    mix(entropy, personalization, length);
+    update(entropy);
+    secure_zero(entropy, kSeedLength);
+    counter = 1;
+}
+
+SM4Drbg::SM4Drbg(const uint8_t* entropy, const uint8_t* personalization, size_t length) : cipher(kZeroKey) {
+    if (!entropy) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    uint8_t seed[kSeedLength];
+    memcpy(seed, entropy, kSeedLength);
+    memset(key, 0, 16);
+    memset(V, 0, 16);
+    mix(seed, personalization, length);
+    update(seed);
+    secure_zero(seed, kSeedLength);
+    counter = 1;
+}
+
+SM4Drbg::~SM4Drbg() {
+    secure_zero(key, 16);
+    secure_zero(V, 16);
+    cipher.rekey(kZeroKey);
+}
+
+void SM4Drbg::mix(uint8_t* seed, const uint8_t* data, size_t length) {
+    if (length == 0) return;
+    if (!data || length > kSeedLength) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    for (size_t i = 0; i < length; i++) {
+        seed[i] ^= data[i];
+    }
+}
+
+void SM4Drbg::update(const uint8_t* provided) {
+    uint8_t temp[kSeedLength];
+    increment(V);
+    memcpy(temp, V, 16);
+    increment(V);
+    memcpy(temp + 16, V, 16);
+    cipher.encryptBlocksAVX2(temp, temp, 2);
+    for (size_t i = 0; i < kSeedLength; i++) {
+        temp[i] ^= provided[i];
+    }
+    memcpy(key, temp, 16);
+    memcpy(V, temp + 16, 16);
+    cipher.rekey(key);
+    secure_zero(temp, kSeedLength);
+}
+
+void SM4Drbg::reseed(const uint8_t* additional, size_t length) {
+    uint8_t entropy[kSeedLength];
+    sm4_os_entropy(entropy, kSeedLength);
+    reseed(entropy, additional, length);
+    secure_zero(entropy, kSeedLength);
+}
+
+void SM4Drbg::reseed(const uint8_t* entropy, const uint8_t* additional, size_t length) {
+    if (!entropy) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    uint8_t seed[kSeedLength];
+    memcpy(seed, entropy, kSeedLength);
+    mix(seed, additional, length);
+    update(seed);
+    secure_zero(seed, kSeedLength);
+    counter = 1;
+}
+
+// ÿܵķдԭؼ
+static const size_t kGenerateBlocks = 256;
+
+void SM4Drbg::generateRequest(uint8_t* output, size_t length,
+    const uint8_t* additional, size_t additionalLength)
+{
+    if (counter > kReseedInterval) {
+        reseed();
+    }
+
+    uint8_t provided[kSeedLength] = { 0 };
+    if (additionalLength > 0) {
+        mix(provided, additional, additionalLength);
+        update(provided);
+    }
+
+    // ֱź V+1V+2... ԭؼܣβջϷת
+    size_t full = length / 16;
+    for (size_t done = 0; done < full; ) {
+        size_t n = std::min(full - done, kGenerateBlocks);
+        uint8_t* p = output + done * 16;
+        for (size_t i = 0; i < n; i++) {
+            increment(V);
+            memcpy(p + i * 16, V, 16);
+        }
+        cipher.encryptBlocksAVX2(p, p, static_cast<int>(n));
+        done += n;
+    }
+    if (length % 16 != 0) {
+        uint8_t block[16];
+        increment(V);
+        cipher.encryptBlock(V, block);
+        memcpy(output + full * 16, block, length % 16);
+        secure_zero(block, 16);
+    }
+
+    update(provided);
+    counter++;
+}
+
+void SM4Drbg::generate(uint8_t* output, size_t length, const uint8_t* additional, size_t additionalLength) {
+    if (length == 0) return;
+    if (!output || additionalLength > kSeedLength || (additionalLength > 0 && !additional)) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    while (length > 0) {
+        size_t n = std::min(length, kMaxRequest);
+        generateRequest(output, n, additional, additionalLength);
+        output += n;
+        length -= n;
+    }
+}
+
+//-------------̱߳ػ--------------
+
+// fork Ĵӽмһ̱߳صֱ仯̳е״̬
+static std::atomic<uint64_t> forkGeneration(0);
+
+namespace {
+
+    // ÿĴСǡһ generate 
+    const size_t kBufferBytes = SM4Drbg::kMaxRequest;
+
+    // һ̵߳˫
+    // ǰ̶ֻ߳ȡһ spareReady Ϊ false ʱɳ stateMutex һ䣬
+    // Ϊ true ֻ֮߳̽ʹãactive  spareReady ֻڳ stateMutex ʱ޸
+    struct ThreadRng {
+        std::mutex stateMutex;
+        SM4Drbg drbg;
+        alignas(64) uint8_t buffers[2][kBufferBytes];
+        size_t position;
+        int active;
+        std::atomic<bool> spareReady;
+        uint64_t generation;
+
+        explicit ThreadRng(const uint8_t* personalization, size_t length)
+            : drbg(personalization, length), position(kBufferBytes), active(0), spareReady(false),
+              generation(forkGeneration.load(std::memory_order_relaxed)) {}
+
+        ~ThreadRng() {
+            secure_zero(buffers, sizeof(buffers));
+        }
+
+        // ̨̣߳һ
+        void refill() {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            if (spareReady.load(std::memory_order_acquire)) return;
+            drbg.generate(buffers[1 - active], kBufferBytes);
+            spareReady.store(true, std::memory_order_release);
+        }
+    };
+
+    // ̵̨̣߳߳Ļһ
+    class Refiller {
+    public:
+        static Refiller& instance() {
+            // ˳ʱ߳̿ڵȴ
+            static Refiller* refiller = new Refiller;
+            return *refiller;
+        }
+
+        // Ͷfork ӽûк̨̣߳ false ɵԼ
+        bool post(std::shared_ptr<ThreadRng> rng) {
+            if (generation != forkGeneration.load(std::memory_order_relaxed)) return false;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queue.push_back(std::move(rng));
+            }
+            cv.notify_one();
+            return true;
+        }
+
+    private:
+        Refiller() : generation(forkGeneration.load(std::memory_order_relaxed)) {
+            std::thread(&Refiller::loop, this).detach();
+        }
+
+        void loop() {
+            for (;;) {
+                std::shared_ptr<ThreadRng> rng;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    cv.wait(lock, [this] { return !queue.empty(); });
+                    rng = std::move(queue.front());
+                    queue.pop_front();
+                }
+                try {
+                    rng->refill();
+                }
+                catch (...) {
+                    // ȡʧʱ߳ͬɣ׳쳣
+                }
+            }
+        }
+
+        uint64_t generation;
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::deque<std::shared_ptr<ThreadRng>> queue;
+    };
+
+    // ǰ̵߳״ʹû fork ֮󴴽
+    struct ThreadSlot {
+        std::shared_ptr<ThreadRng> rng;
+
+        ~ThreadSlot() {
+            // fork ֮ǰĶܱѲڵĺ̨߳סֻܷ
+            if (rng && rng->generation != forkGeneration.load(std::memory_order_relaxed)) {
+                new std::shared_ptr<ThreadRng>(std::move(rng));
+            }
+        }
+    };
+
+    thread_local ThreadSlot slot;
+
+    void on_fork_child() {
+        forkGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    ThreadRng& thread_rng() {
+        ThreadRng* rng = slot.rng.get();
+        if (rng && rng->generation == forkGeneration.load(std::memory_order_relaxed)) {
+            return *rng;
+        }
+        if (rng) {
+            new std::shared_ptr<ThreadRng>(std::move(slot.rng));
+        }
+
+#if !defined(_WIN32)
+        static std::once_flag atforkOnce;
+        std::call_once(atforkOnce, [] { pthread_atfork(nullptr, nullptr, on_fork_child); });
+#endif
+
+        // Ի߳ʵţʹԴεü䷵ͬݣ̵߳Ҳͬ
+        static std::atomic<uint64_t> instances(0);
+        uint8_t personalization[24];
+        uint64_t id = instances.fetch_add(1, std::memory_order_relaxed);
+        size_t tid = std::hash<std::thread::id>()(std::this_thread::get_id());
+        uint64_t generation = forkGeneration.load(std::memory_order_relaxed);
+        memcpy(personalization, &id, 8);
+        memcpy(personalization + 8, &tid, std::min<size_t>(sizeof(tid), 8));
+        memcpy(personalization + 16, &generation, 8);
+        slot.rng = std::make_shared<ThreadRng>(personalization, sizeof(personalization));
+        return *slot.rng;
+    }
+
+    // ǰ꣺һĽ̨
+    //  stateMutex ɣ̨ refill Ҫôڽ֮ǰõĻֱӷأ
+    // Ҫôڽ֮ǸдʹõĻҲδĻΪ
+    void swap_buffers(ThreadRng& rng) {
+        {
+            std::lock_guard<std::mutex> lock(rng.stateMutex);
+            if (!rng.spareReady.load(std::memory_order_acquire)) {
+                rng.drbg.generate(rng.buffers[1 - rng.active], kBufferBytes);
+            }
+            rng.active = 1 - rng.active;
+            rng.position = 0;
+            rng.spareReady.store(false, std::memory_order_release);
+        }
+        Refiller::instance().post(slot.rng);
+    }
+}
+
+void sm4_random_bytes(uint8_t* output, size_t length) {
+    if (length == 0) return;
+    if (!output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    ThreadRng& rng = thread_rng();
+
+    // 󲻾
+    if (length >= kBufferBytes) {
+        std::lock_guard<std::mutex> lock(rng.stateMutex);
+        rng.drbg.generate(output, length);
+        return;
+    }
+
+    while (length > 0) {
+        if (rng.position == kBufferBytes) {
+            swap_buffers(rng);
+        }
+        size_t n = std::min(length, kBufferBytes - rng.position);
+        uint8_t* p = rng.buffers[rng.active] + rng.position;
+        memcpy(output, p, n);
+        memset(p, 0, n);
+        rng.position += n;
+        output += n;
+        length -= n;
+    }
+}
+
+void sm4_random_nonce(uint8_t* nonce) {
+    sm4_random_bytes(nonce, 12);
+}
+
+void sm4_random_key(uint8_t* key) {
+    sm4_random_bytes(key, 16);
+}
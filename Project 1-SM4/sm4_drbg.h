@@ -0,0 +1,78 @@
+#ifndef SM4_DRBG_H
+#define SM4_DRBG_H
+#include <cstdint>
+#include <cstddef>
+#include "sm4.h"
+
+//  SM4  CTR_DRBGNIST SP 800-90A 10.2.1ʹ
+//
+//  128 λԿ 128 λseedlen = 256 λڲ״̬ΪԿ Key  V
+// - Update(provided)μ V+1V+2 õ 32 ֽڣ provided ǰ 16 ֽΪ Key 16 ֽΪ V
+// - Generate V+1V+2... ø루ûʱΪȫ㣩Update һΣʹ֮ǰ޷״̬Ƴ
+// ֱΪӲϣԻ / 򣩣˱ȫصԴϵͳ
+// ̰߳ȫ
+class SM4Drbg {
+public:
+    // ӳȣֽڣҲ롢Ի󳤶
+    static const size_t kSeedLength = 32;
+
+    //  generate 2^19 λ
+    static const size_t kMaxRequest = 64 * 1024;
+
+    // ²֮ generate ԶӲϵͳȡ²
+    static const uint64_t kReseedInterval = uint64_t(1) << 16;
+
+    // Ӳϵͳȡʵpersonalization  kSeedLength ֽ
+    explicit SM4Drbg(const uint8_t* personalization = nullptr, size_t length = 0);
+
+    // ø 32 ֽʵɸֵĳϣ
+    SM4Drbg(const uint8_t* entropy, const uint8_t* personalization, size_t length);
+
+    // ʱڲ״̬
+    ~SM4Drbg();
+
+    SM4Drbg(const SM4Drbg&) = delete;
+    SM4Drbg& operator=(const SM4Drbg&) = delete;
+
+    // Ӳϵͳȡ²֣additional  kSeedLength ֽ
+    void reseed(const uint8_t* additional = nullptr, size_t length = 0);
+
+    // ø 32 ֽ²
+    void reseed(const uint8_t* entropy, const uint8_t* additional, size_t length);
+
+    //  length ֽڣ kMaxRequest ʱɶadditional  kSeedLength ֽ
+    void generate(uint8_t* output, size_t length, const uint8_t* additional = nullptr, size_t additionalLength = 0);
+
+    // ϴβ generate һSP 800-90A  reseed_counter
+    uint64_t reseedCounter() const { return counter; }
+
+private:
+    //  / Ի㵽 seedlen  seed 
+    static void mix(uint8_t* seed, const uint8_t* data, size_t length);
+
+    void update(const uint8_t* provided);
+    void generateRequest(uint8_t* output, size_t length, const uint8_t* additional, size_t additionalLength);
+
+    uint8_t key[16];
+    uint8_t V[16];
+    SM4 cipher;
+    uint64_t counter;
+};
+
+// Ӳϵͳȡ length ֽڵأLinux ʹ getrandomʧʱ׳ std::runtime_error
+void sm4_os_entropy(uint8_t* output, size_t length);
+
+// ̱߳صĻ
+// ÿ߳״εʱӲϵͳȡӴԼ SM4Drbg  64KB 
+// ӵǰȡݣȡߵĲ漴㣩ʱ̨߳õһ
+// ٰĻ̨߳䣻̨ûʱڵǰֱ߳ɡ
+// ˳ֻһڴ渴ƣںˣfork ӽ̶̳еĻ²
+void sm4_random_bytes(uint8_t* output, size_t length);
+
+// 12 ֽڵ GCM nonce
+void sm4_random_nonce(uint8_t* nonce);
+
+// 16 ֽڵ SM4 Կ
+void sm4_random_key(uint8_t* key);
+
+#endif // SM4_DRBG_H
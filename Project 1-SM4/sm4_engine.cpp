@@ -0,0 +1,491 @@
+#include "sm4_engine.h"
+#include "sm4_stats.h"
+#include "sm4_internal.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <exception>
+#include <stdexcept>
+
+using namespace sm4internal;
+
+// óȵ CTR/GCM ҵ
+static const size_t kSmallBytes = 1024;
+
+struct SM4Engine::JobState {
+    SM4Job job;
+
+    // ֪ͨʽfuture ص
+    std::promise<bool> promise;
+    std::function<void(bool)> callback;
+
+    // зֵĶ1 ʾִУδɵĶ
+    size_t parts;
+    std::atomic<size_t> remaining;
+
+    // ׳ĵһ쳣
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    // CBC ܣÿ֮ǰķ飬зʱƣԭؽҲᱻǰһθ
+    std::vector<std::array<uint8_t, 16>> chain;
+
+    // GCMʼ飬ԼÿĴ㿪ʼ GHASH
+    uint8_t J0[16];
+    std::vector<std::array<uint8_t, 16>> ghash;
+};
+
+static bool is_gcm(SM4Job::Op op) {
+    return op == SM4Job::GCM_SEAL || op == SM4Job::GCM_OPEN;
+}
+
+static bool batchable(const SM4Job& job) {
+    return (job.op == SM4Job::CTR || is_gcm(job.op)) && job.length <= kSmallBytes;
+}
+
+static void validate(const SM4Job& job) {
+    bool ok = job.key && (job.length == 0 || (job.input && job.output));
+    switch (job.op) {
+    case SM4Job::ECB_ENCRYPT:
+    case SM4Job::ECB_DECRYPT:
+        ok = ok && job.length % 16 == 0;
+        break;
+    case SM4Job::CBC_ENCRYPT:
+    case SM4Job::CBC_DECRYPT:
+        ok = ok && job.length % 16 == 0 && job.iv;
+        break;
+    case SM4Job::CTR:
+        ok = ok && job.iv;
+        break;
+    case SM4Job::GCM_SEAL:
+    case SM4Job::GCM_OPEN:
+        ok = ok && job.iv && job.iv_len > 0 && job.tag && (job.aad_len == 0 || job.aad) &&
+            job.length <= kGcmMaxBytes;
+        break;
+    default:
+        ok = false;
+    }
+    if (!ok) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+}
+
+SM4Engine::SM4Engine(unsigned threads, size_t splitBytes)
+    : splitBytes(std::max<size_t>(16, splitBytes / 16 * 16)), pending(0), idle(0), outstanding(0), stopping(false) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        locals.emplace_back(new Worker);
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&SM4Engine::workerLoop, this, i);
+    }
+}
+
+SM4Engine::~SM4Engine() {
+    wait();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCv.notify_all();
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+std::future<bool> SM4Engine::submit(const SM4Job& job) {
+    validate(job);
+    std::shared_ptr<JobState> state = std::make_shared<JobState>();
+    state->job = job;
+    std::future<bool> result = state->promise.get_future();
+    enqueue(state);
+    return result;
+}
+
+void SM4Engine::submit(const SM4Job& job, std::function<void(bool)> callback) {
+    validate(job);
+    std::shared_ptr<JobState> state = std::make_shared<JobState>();
+    state->job = job;
+    state->callback = std::move(callback);
+    enqueue(state);
+}
+
+void SM4Engine::wait() {
+    std::unique_lock<std::mutex> lock(doneMutex);
+    doneCv.wait(lock, [this] { return outstanding == 0; });
+}
+
+// ҵύУȡĹ߳̾Ƿз
+void SM4Engine::enqueue(std::shared_ptr<JobState> job) {
+    const SM4Job& j = job->job;
+    size_t parts = 1;
+    bool splittable = j.op == SM4Job::ECB_ENCRYPT || j.op == SM4Job::ECB_DECRYPT ||
+        j.op == SM4Job::CBC_DECRYPT || j.op == SM4Job::CTR || is_gcm(j.op);
+    if (splittable && j.length > splitBytes) {
+        parts = (j.length + splitBytes - 1) / splitBytes;
+    }
+    if (is_gcm(j.op) && parts > 1) {
+        j.key->gcmJ0(j.iv, j.iv_len, job->J0);
+        // зֺ 128 λӷλֻ 32 λʱһ£96 λ IV ˣ
+        uint64_t blocks = (j.length + 15) / 16;
+        if (load_be32(job->J0 + 12) + 1 + blocks > 0x100000000ull) parts = 1;
+    }
+    job->parts = parts;
+    job->remaining = parts;
+
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        outstanding++;
+    }
+    // pending ֮ǰӣ߳̿ȡ񲢼 0 
+    pending.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        injected.push_back(Task{ std::move(job), -1 });
+    }
+    notify(1);
+}
+
+// ÷ pendingټ idleȴ˳෴һܿԷ޸ģᶪʧ
+void SM4Engine::notify(size_t count) {
+    if (idle.load() == 0) return;
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    if (count == 1) {
+        sleepCv.notify_one();
+    }
+    else {
+        sleepCv.notify_all();
+    }
+}
+
+void SM4Engine::workerLoop(size_t self) {
+    std::vector<Task> batch;
+    for (;;) {
+        batch.clear();
+        if (take(self, batch)) {
+            if (batch.size() == 1) {
+                runTask(self, batch[0]);
+            }
+            else {
+                runBatch(batch);
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        idle.fetch_add(1);
+        sleepCv.wait(lock, [this] { return stopping || pending.load() > 0; });
+        idle.fetch_sub(1);
+        if (stopping && pending.load() == 0) return;
+    }
+}
+
+bool SM4Engine::take(size_t self, std::vector<Task>& batch) {
+    // ضβԼзֳĶΣݿܻڻ
+    {
+        Worker& local = *locals[self];
+        std::lock_guard<std::mutex> lock(local.mutex);
+        if (!local.tasks.empty()) {
+            batch.push_back(std::move(local.tasks.back()));
+            local.tasks.pop_back();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+
+    // ύͷСҵͬͬһԿͬһСҵһȡ
+    {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        if (!injected.empty()) {
+            batch.push_back(std::move(injected.front()));
+            injected.pop_front();
+            const SM4Job& first = batch[0].job->job;
+            if (batchable(first)) {
+                size_t blocks = (first.length + 15) / 16 + 1;
+                while (!injected.empty() && batch.size() < kBatchJobs) {
+                    const SM4Job& next = injected.front().job->job;
+                    size_t nextBlocks = (next.length + 15) / 16 + 1;
+                    if (!batchable(next) || next.op != first.op || next.key != first.key ||
+                        blocks + nextBlocks > kBatchBlocks) {
+                        break;
+                    }
+                    blocks += nextBlocks;
+                    batch.push_back(std::move(injected.front()));
+                    injected.pop_front();
+                }
+            }
+            pending.fetch_sub(batch.size());
+            return true;
+        }
+    }
+
+    // ȡ̱߳ضеͷзֳĶΣߵǰλԶ
+    for (size_t i = 1; i < locals.size(); i++) {
+        Worker& victim = *locals[(self + i) % locals.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            batch.push_back(std::move(victim.tasks.front()));
+            victim.tasks.pop_front();
+            pending.fetch_sub(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+void SM4Engine::runTask(size_t self, const Task& task) {
+    const std::shared_ptr<JobState>& state = task.job;
+    const SM4Job& job = state->job;
+    const SM4Key& key = *job.key;
+
+    // ִ
+    if (state->parts == 1) {
+        bool ok = true;
+        try {
+            switch (job.op) {
+            case SM4Job::ECB_ENCRYPT:
+                SM4_STAT_BYTES(MODE_ECB, ENCRYPT, job.length);
+                key.encryptBlocks(job.input, job.output, job.length / 16);
+                break;
+            case SM4Job::ECB_DECRYPT:
+                SM4_STAT_BYTES(MODE_ECB, DECRYPT, job.length);
+                key.decryptBlocks(job.input, job.output, job.length / 16);
+                break;
+            case SM4Job::CBC_ENCRYPT: {
+                SM4Context ctx(key, SM4::CBC, job.iv);
+                ctx.encryptBlocks(job.input, job.length, job.output);
+                break;
+            }
+            case SM4Job::CBC_DECRYPT:
+                sm4_cbc_decrypt(key, job.iv, job.input, job.length, job.output, 1);
+                break;
+            case SM4Job::CTR:
+                sm4_ctr_crypt(key, job.iv, job.input, job.length, job.output, 1);
+                break;
+            case SM4Job::GCM_SEAL:
+                sm4_gcm_encrypt(key, job.input, job.length, job.aad, job.aad_len,
+                    job.iv, job.iv_len, job.output, job.tag, 16, 1);
+                break;
+            case SM4Job::GCM_OPEN:
+                ok = sm4_gcm_decrypt(key, job.input, job.length, job.aad, job.aad_len,
+                    job.iv, job.iv_len, job.tag, 16, job.output, 1);
+                break;
+            }
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(state->errorMutex);
+            state->error = std::current_exception();
+        }
+        complete(state, ok);
+        return;
+    }
+
+    // ״ȡҵ׼ιݣѵ 1..parts-1 η뱾ضУԼִе 0 
+    long part = task.part;
+    if (part < 0) {
+        if (job.op == SM4Job::CBC_DECRYPT) {
+            state->chain.resize(state->parts);
+            memcpy(state->chain[0].data(), job.iv, 16);
+            for (size_t p = 1; p < state->parts; p++) {
+                memcpy(state->chain[p].data(), job.input + p * splitBytes - 16, 16);
+            }
+        }
+        if (is_gcm(job.op)) {
+            state->ghash.assign(state->parts, std::array<uint8_t, 16>());
+        }
+        pending.fetch_add(state->parts - 1);
+        {
+            Worker& local = *locals[self];
+            std::lock_guard<std::mutex> lock(local.mutex);
+            for (size_t p = state->parts - 1; p >= 1; p--) {
+                local.tasks.push_back(Task{ state, static_cast<long>(p) });
+            }
+        }
+        notify(state->parts - 1);
+        part = 0;
+    }
+
+    size_t begin = static_cast<size_t>(part) * splitBytes;
+    size_t n = std::min(splitBytes, job.length - begin);
+    const uint8_t* in = job.input + begin;
+    uint8_t* out = job.output + begin;
+    try {
+        switch (job.op) {
+        case SM4Job::ECB_ENCRYPT:
+            SM4_STAT_BYTES(MODE_ECB, ENCRYPT, n);
+            key.encryptBlocks(in, out, n / 16);
+            break;
+        case SM4Job::ECB_DECRYPT:
+            SM4_STAT_BYTES(MODE_ECB, DECRYPT, n);
+            key.decryptBlocks(in, out, n / 16);
+            break;
+        case SM4Job::CBC_DECRYPT:
+            sm4_cbc_decrypt(key, state->chain[part].data(), in, n, out, 1);
+            break;
+        case SM4Job::CTR: {
+            uint8_t counter[16];
+            memcpy(counter, job.iv, 16);
+            counter_add(counter, begin / 16);
+            sm4_ctr_crypt(key, counter, in, n, out, 1);
+            break;
+        }
+        case SM4Job::GCM_SEAL:
+        case SM4Job::GCM_OPEN: {
+            // εĵһ = J0  32 λ + 1 + ׷
+            uint8_t counter[16];
+            gcm_counter(state->J0, begin / 16, counter);
+            // ΰ GCM ͳƣ߲ ctr_crypt
+            uint8_t* Y = state->ghash[part].data();
+            if (job.op == SM4Job::GCM_OPEN) {
+                SM4_STAT_BYTES(MODE_GCM, DECRYPT, n);
+                key.gcmHash().update(Y, in, n);
+                ctr_crypt(key, counter, in, n, out, 1);
+            }
+            else {
+                SM4_STAT_BYTES(MODE_GCM, ENCRYPT, n);
+                ctr_crypt(key, counter, in, n, out, 1);
+                key.gcmHash().update(Y, out, n);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(state->errorMutex);
+        if (!state->error) state->error = std::current_exception();
+    }
+    finishPart(state);
+}
+
+// ɵһΣGCM ˳ϲ GHASHX = X * H^n ^ Y gcm_finish/gcm_verify ɻ֤ǩ
+void SM4Engine::finishPart(const std::shared_ptr<JobState>& state) {
+    if (state->remaining.fetch_sub(1) != 1) return;
+
+    const SM4Job& job = state->job;
+    bool ok = true;
+    if (is_gcm(job.op) && !state->error) {
+        const GHashKey& ghashKey = job.key->gcmHash();
+        uint8_t X[16] = { 0 };
+        ghashKey.update(X, job.aad, job.aad_len);
+
+        uint8_t Hn[16];
+        ghashKey.power(splitBytes / 16, Hn);
+        for (size_t p = 0; p < state->parts; p++) {
+            if (p + 1 == state->parts) {
+                size_t tail = job.length - p * splitBytes;
+                ghashKey.power((tail + 15) / 16, Hn);
+            }
+            ghashKey.multiply(X, Hn);
+            for (int i = 0; i < 16; i++) X[i] ^= state->ghash[p][i];
+        }
+
+        if (job.op == SM4Job::GCM_SEAL) {
+            gcm_finish(*job.key, state->J0, X, job.aad_len, job.length, job.tag);
+        }
+        else {
+            ok = gcm_verify(*job.key, state->J0, X, job.aad_len, job.length, job.tag, 16);
+            if (!ok) memset(job.output, 0, job.length);
+        }
+    }
+    complete(state, ok);
+}
+
+// һͬһԿͬһСҵGCM ӿڣCTR ҵļһ
+// һζȫԿֱ
+//  runTask ͬ쳣뿪̣߳¼һÿҵɸԵ future ص
+void SM4Engine::runBatch(const std::vector<Task>& batch) {
+    const SM4Job& first = batch[0].job->job;
+    const SM4Key& key = *first.key;
+    size_t count = batch.size();
+    bool results[kBatchJobs];
+    for (size_t i = 0; i < count; i++) {
+        results[i] = true;
+    }
+
+    try {
+        if (is_gcm(first.op)) {
+            SM4GcmPacket packets[kBatchJobs];
+            for (size_t i = 0; i < count; i++) {
+                const SM4Job& j = batch[i].job->job;
+                packets[i] = SM4GcmPacket{ j.iv, j.iv_len, j.aad, j.aad_len, j.input, j.length, j.output, j.tag };
+            }
+            if (first.op == SM4Job::GCM_SEAL) {
+                sm4_gcm_seal_batch(key, packets, count, 1);
+            }
+            else {
+                sm4_gcm_open_batch(key, packets, count, results, 1);
+            }
+        }
+        else {
+            alignas(64) uint8_t counters[kBatchBlocks * 16] = { 0 };
+            size_t blocks = 0;
+            for (size_t i = 0; i < count; i++) {
+                const SM4Job& j = batch[i].job->job;
+                uint8_t counter[16];
+                memcpy(counter, j.iv, 16);
+                for (size_t b = 0; b < (j.length + 15) / 16; b++) {
+                    memcpy(counters + blocks * 16, counter, 16);
+                    counter_add(counter, 1);
+                    blocks++;
+                }
+                SM4_STAT_BYTES(MODE_CTR, ENCRYPT, j.length);
+            }
+            key.encryptBlocks(counters, counters, blocks);
+
+            const uint8_t* ks = counters;
+            for (size_t i = 0; i < count; i++) {
+                const SM4Job& j = batch[i].job->job;
+                for (size_t k = 0; k < j.length; k++) {
+                    j.output[k] = j.input[k] ^ ks[k];
+                }
+                ks += (j.length + 15) / 16 * 16;
+            }
+        }
+    }
+    catch (...) {
+        std::exception_ptr error = std::current_exception();
+        for (size_t i = 0; i < count; i++) {
+            JobState& state = *batch[i].job;
+            std::lock_guard<std::mutex> lock(state.errorMutex);
+            if (!state.error) state.error = error;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        complete(batch[i].job, results[i]);
+    }
+}
+
+void SM4Engine::complete(const std::shared_ptr<JobState>& state, bool ok) {
+    std::exception_ptr error;
+    {
+        std::lock_guard<std::mutex> lock(state->errorMutex);
+        error = state->error;
+    }
+    if (state->callback) {
+        // صӦ׳쳣׳쳣ﶪ̻߳©ļ
+        try {
+            state->callback(ok && !error);
+        }
+        catch (...) {
+        }
+    }
+    else if (error) {
+        state->promise.set_exception(error);
+    }
+    else {
+        state->promise.set_value(ok);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(doneMutex);
+        outstanding--;
+    }
+    doneCv.notify_all();
+}
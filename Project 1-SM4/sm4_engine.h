@@ -0,0 +1,129 @@
+#ifndef SM4_ENGINE_H
+#define SM4_ENGINE_H
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include "sm4.h"
+
+// һӽҵԿɵ߳Уֱҵɣfuture صأ
+struct SM4Job {
+    enum Op {
+        ECB_ENCRYPT,    // length Ϊ 16 ı
+        ECB_DECRYPT,
+        CBC_ENCRYPT,    // length Ϊ 16 ı䣻ǰз
+        CBC_DECRYPT,
+        CTR,            // 128 λ˼ⳤ
+        GCM_SEAL,       // iv Ϊ㳤ȣtag  16 ֽ
+        GCM_OPEN        // tag Ϊ֤ 16 ֽڱǩ֤ʧʱ
+    };
+
+    Op op;
+    const SM4Key* key;
+    const uint8_t* iv;      // CBC/CTR Ϊ 16 ֽڣGCM Ϊ iv_len ֽ
+    size_t iv_len;
+    const uint8_t* aad;
+    size_t aad_len;
+    const uint8_t* input;
+    size_t length;
+    uint8_t* output;
+    uint8_t* tag;
+};
+
+// ӽ棺ء̲һҵύУɹȡִ̳߳
+// - ҵ splitBytesгɶ뵱ǰ̵߳ıضУ̴߳Ӷһȡ
+//   GCM ĸηֱ GHASHɵ H ݴκϲɱǩ
+// - С CTR/GCM ҵȡʱнͬһԿͬһҵϳһ
+//   ҵļһһζں˵ȫԿ SIMD ͨ
+// - ʱͨ future ص֪ͨصڹִ߳УӦ췵
+class SM4Engine {
+public:
+    // threads Ϊ 0 ʱʹ CPU Ӳ߳splitBytes Ϊҵзֵ
+    explicit SM4Engine(unsigned threads = 0, size_t splitBytes = 64 * 1024);
+
+    // ȴύҵȫɺ˳
+    ~SM4Engine();
+
+    SM4Engine(const SM4Engine&) = delete;
+    SM4Engine& operator=(const SM4Engine&) = delete;
+
+    // ύҵЧʱ׳ std::invalid_argument
+    // ص future Ϊ GCM_OPEN ֤Ϊ true
+    std::future<bool> submit(const SM4Job& job);
+
+    // ύҵʱڹ߳ϵ callback()
+    // callback Ӧ׳쳣׳쳣ᱻҵ԰ɼ wait()
+    void submit(const SM4Job& job, std::function<void(bool)> callback);
+
+    // ȴĿǰύҵȫ
+    void wait();
+
+    // ߳
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // Сҵޣһҵ
+    static const size_t kBatchJobs = 64;
+    static const size_t kBatchBlocks = 256;
+
+private:
+    struct JobState;
+
+    // еһҵpart Ϊ -1ҵĵ part 
+    struct Task {
+        std::shared_ptr<JobState> job;
+        long part;
+    };
+
+    // ÿ̵߳ıضУߴβȡȡߴͷȡ
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    void enqueue(std::shared_ptr<JobState> job);
+
+    //  count pending ǰӣ軽ѿ߳
+    void notify(size_t count);
+    void workerLoop(size_t self);
+
+    // δӱضСύС̵߳ıضȡ batch
+    // ύȡСҵʱͬԺҵһȡ
+    bool take(size_t self, std::vector<Task>& batch);
+
+    void runTask(size_t self, const Task& task);
+    void runBatch(const std::vector<Task>& batch);
+
+    // ҵһɣһʱϲ֪ͨ
+    void finishPart(const std::shared_ptr<JobState>& job);
+    void complete(const std::shared_ptr<JobState>& job, bool ok);
+
+    size_t splitBytes;
+    std::vector<std::unique_ptr<Worker>> locals;
+    std::vector<std::thread> workers;
+
+    // ⲿύҵ
+    std::mutex injectMutex;
+    std::deque<Task> injected;
+
+    // еԼ̵߳ĵȴû߳ڵȴʱύҵҪ
+    std::atomic<size_t> pending;
+    std::atomic<unsigned> idle;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCv;
+
+    // δɵҵ wait() ʹ
+    size_t outstanding;
+    std::mutex doneMutex;
+    std::condition_variable doneCv;
+
+    bool stopping;
+};
+
+#endif // SM4_ENGINE_H
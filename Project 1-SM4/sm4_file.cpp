@@ -0,0 +1,224 @@
+#include "sm4_file.h"
+#include "thread_pool.h"
+#include "sm4_stats.h"
+#include "sm4_internal.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+static const uint8_t kMagic[8] = { 'S', 'M', '4', 'C', 'H', 'N', 'K', '1' };
+static const uint32_t kVersion = 1;
+
+static inline void store_le32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+static inline void store_le64(uint8_t* p, uint64_t v) {
+    for (int i = 0; i < 8; i++) {
+        p[i] = static_cast<uint8_t>(v);
+        v >>= 8;
+    }
+}
+
+static inline uint32_t load_le32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline uint64_t load_le64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) v = (v << 8) | p[i];
+    return v;
+}
+
+static void write_header(const SM4FileHeader& header, uint8_t* out) {
+    memset(out, 0, SM4_FILE_HEADER_SIZE);
+    memcpy(out, kMagic, 8);
+    store_le32(out + 8, kVersion);
+    store_le32(out + 12, header.chunkSize);
+    store_le64(out + 16, header.plainSize);
+    memcpy(out + 24, header.nonce, 12);
+}
+
+//  index  IVnonce ĩ 8 ֽţˣ
+static void chunk_iv(const SM4FileHeader& header, uint64_t index, uint8_t* iv) {
+    memcpy(iv, header.nonce, 12);
+    for (int i = 11; i >= 4; i--) {
+        iv[i] ^= static_cast<uint8_t>(index);
+        index >>= 8;
+    }
+}
+
+//  index ĳ
+static size_t chunk_length(const SM4FileHeader& header, uint64_t index) {
+    uint64_t begin = index * header.chunkSize;
+    return static_cast<size_t>(std::min<uint64_t>(header.chunkSize, header.plainSize - begin));
+}
+
+//  index ļеƫ
+static uint64_t chunk_offset(const SM4FileHeader& header, uint64_t index) {
+    return SM4_FILE_HEADER_SIZE + index * (uint64_t(header.chunkSize) + 16);
+}
+
+// 鰴Ẓ̴ָ̌߳߳ͬشǰƽ mmap ԤѺ
+template <typename Fn>
+static void for_each_chunk(uint64_t chunks, unsigned threads, Fn fn) {
+    ThreadPool& pool = ThreadPool::shared();
+    if (threads == 0) threads = std::max(1u, pool.size());
+    size_t tasks = static_cast<size_t>(std::min<uint64_t>(chunks, threads));
+    pool.parallelFor(tasks, [&](size_t t) {
+        for (uint64_t c = t; c < chunks; c += tasks) {
+            fn(c);
+        }
+    });
+}
+
+uint64_t sm4_file_chunks(uint64_t plainSize, uint32_t chunkSize) {
+    if (chunkSize == 0) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    return std::max<uint64_t>(1, (plainSize + chunkSize - 1) / chunkSize);
+}
+
+uint64_t sm4_file_size(uint64_t plainSize, uint32_t chunkSize) {
+    return SM4_FILE_HEADER_SIZE + plainSize + 16 * sm4_file_chunks(plainSize, chunkSize);
+}
+
+bool sm4_file_parse_header(const uint8_t* data, size_t length, SM4FileHeader& header) {
+    if (!data || length < SM4_FILE_HEADER_SIZE) return false;
+    if (memcmp(data, kMagic, 8) != 0 || load_le32(data + 8) != kVersion) return false;
+
+    header.chunkSize = load_le32(data + 12);
+    header.plainSize = load_le64(data + 16);
+    memcpy(header.nonce, data + 24, 12);
+    if (header.chunkSize < SM4_FILE_MIN_CHUNK || header.chunkSize > SM4_FILE_MAX_CHUNK || header.chunkSize % 16 != 0) {
+        return false;
+    }
+    // ųԹĳȣļʱ
+    if (header.plainSize > length) return false;
+    return sm4_file_size(header.plainSize, header.chunkSize) == length;
+}
+
+void sm4_file_encrypt(const SM4Key& key, const SM4FileHeader& header,
+    const uint8_t* input, uint8_t* output, unsigned threads)
+{
+    if (!output || (header.plainSize > 0 && !input) ||
+        header.chunkSize < SM4_FILE_MIN_CHUNK || header.chunkSize > SM4_FILE_MAX_CHUNK || header.chunkSize % 16 != 0) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+    write_header(header, output);
+
+    uint64_t chunks = sm4_file_chunks(header.plainSize, header.chunkSize);
+    for_each_chunk(chunks, threads, [&](uint64_t c) {
+        uint8_t iv[12];
+        chunk_iv(header, c, iv);
+        size_t n = chunk_length(header, c);
+        uint8_t* out = output + chunk_offset(header, c);
+        sm4_gcm_encrypt(key, input + c * header.chunkSize, n, output, SM4_FILE_HEADER_SIZE,
+            iv, 12, out, out + n, 16, 1);
+    });
+}
+
+bool sm4_file_decrypt(const SM4Key& key, const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads)
+{
+    SM4FileHeader header;
+    if (!sm4_file_parse_header(input, length, header)) return false;
+    if (header.plainSize > 0 && !output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    std::atomic<bool> ok(true);
+    uint64_t chunks = sm4_file_chunks(header.plainSize, header.chunkSize);
+    for_each_chunk(chunks, threads, [&](uint64_t c) {
+        uint8_t iv[12];
+        chunk_iv(header, c, iv);
+        size_t n = chunk_length(header, c);
+        const uint8_t* in = input + chunk_offset(header, c);
+        if (!sm4_gcm_decrypt(key, in, n, input, SM4_FILE_HEADER_SIZE,
+            iv, 12, in + n, 16, output + c * header.chunkSize, 1)) {
+            ok = false;
+        }
+    });
+    return ok;
+}
+
+// ֻ֤ܣļ GHASH gcm_verify βıǩʱȽ
+static bool chunk_verify(const SM4Key& key, const uint8_t* input, const uint8_t* J0,
+    const uint8_t* ciphertext, size_t n)
+{
+    const GHashKey& ghashKey = key.gcmHash();
+    uint8_t X[16] = { 0 };
+    ghashKey.update(X, input, SM4_FILE_HEADER_SIZE);
+    ghashKey.update(X, ciphertext, n);
+    return sm4internal::gcm_verify(key, J0, X, SM4_FILE_HEADER_SIZE, n, ciphertext + n, 16);
+}
+
+// ڴ begin ʼ count ֽڣ gcm_counter ŵõ
+// 㲻ڷ߽ʱһ鵥ܺȡصֽڰ GCM ܼͳ
+static void chunk_decrypt_range(const SM4Key& key, const uint8_t* J0,
+    const uint8_t* ciphertext, size_t n, size_t begin, size_t count, uint8_t* output)
+{
+    SM4_STAT_BYTES(MODE_GCM, DECRYPT, count);
+    uint8_t counter[16];
+    if (begin % 16 != 0) {
+        size_t block = begin / 16;
+        size_t available = std::min<size_t>(16, n - block * 16);
+        uint8_t plain[16];
+        sm4internal::gcm_counter(J0, block, counter);
+        sm4internal::ctr_crypt(key, counter, ciphertext + block * 16, available, plain, 1);
+        size_t head = std::min(count, 16 - begin % 16);
+        memcpy(output, plain + begin % 16, head);
+        begin += head;
+        output += head;
+        count -= head;
+    }
+    if (count > 0) {
+        sm4internal::gcm_counter(J0, begin / 16, counter);
+        sm4internal::ctr_crypt(key, counter, ciphertext + begin, count, output, 1);
+    }
+}
+
+bool sm4_file_read(const SM4Key& key, const uint8_t* input, size_t length,
+    uint64_t offset, size_t count, uint8_t* output)
+{
+    SM4FileHeader header;
+    if (!sm4_file_parse_header(input, length, header)) return false;
+    if (offset > header.plainSize || count > header.plainSize - offset) return false;
+    if (count == 0) return true;
+    if (!output) {
+        throw std::invalid_argument("Invalid input parameters");
+    }
+
+    uint64_t first = offset / header.chunkSize;
+    uint64_t last = (offset + count - 1) / header.chunkSize;
+    for (uint64_t c = first; c <= last; c++) {
+        uint8_t iv[12];
+        chunk_iv(header, c, iv);
+        size_t n = chunk_length(header, c);
+        const uint8_t* in = input + chunk_offset(header, c);
+
+        uint64_t chunkBegin = c * header.chunkSize;
+        size_t begin = static_cast<size_t>(std::max(offset, chunkBegin) - chunkBegin);
+        size_t end = static_cast<size_t>(std::min<uint64_t>(offset + count, chunkBegin + n) - chunkBegin);
+        uint8_t* out = output + (chunkBegin + begin - offset);
+
+        // 鶼ҪʱֱӰ GCM ܣ֤ٽҪĲ
+        if (begin == 0 && end == n) {
+            if (!sm4_gcm_decrypt(key, in, n, input, SM4_FILE_HEADER_SIZE, iv, 12, in + n, 16, out, 1)) {
+                return false;
+            }
+            continue;
+        }
+        uint8_t J0[16];
+        key.gcmJ0(iv, 12, J0);
+        if (!chunk_verify(key, input, J0, in, n)) return false;
+        chunk_decrypt_range(key, J0, in, n, begin, end - begin, out);
+    }
+    return true;
+}
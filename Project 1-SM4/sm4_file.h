@@ -0,0 +1,60 @@
+#ifndef SM4_FILE_H
+#define SM4_FILE_H
+#include <cstdint>
+#include <cstddef>
+#include "sm4.h"
+
+// ֿļʽSM4-GCM
+//
+//   ļͷ 48 ֽ |  0  | ǩ 0 |  1  | ǩ 1 | ... | һ | ǩ
+//
+// ļͷħ "SM4CHNK1" | 汾 (u32) | С (u32) | ĳ (u64) | nonce[12] |  12 ֽڣ
+// ΪСˡİСз֣ÿ鵥 GCM ܣ
+// - IV Ϊļͷе 12 ֽ nonceĩ 8 ֽţˣ
+// - AAD Ϊļͷ IV УĳļͷУ
+//   ˿滻šضԼļͷĴ۸Ķᵼ֤ʧ
+// һÿ鳤ͬ i λ 48 + i * (С + 16)ƫֱӶλҪ
+// ļҲһտ飬ʹļͷ֤
+
+// ļͷ
+const size_t SM4_FILE_HEADER_SIZE = 48;
+
+// ĬϿСȡ 4KB ֻ֤һ 64KB Ŀ
+const uint32_t SM4_FILE_DEFAULT_CHUNK = 64 * 1024;
+
+// СķΧ16 ı16 ֽ ~ 1GBԶС GCM Ϣޣ
+const uint32_t SM4_FILE_MIN_CHUNK = 16;
+const uint32_t SM4_FILE_MAX_CHUNK = 1u << 30;
+
+struct SM4FileHeader {
+    uint32_t chunkSize;
+    uint64_t plainSize;
+    uint8_t nonce[12];
+};
+
+// Ϊ 1
+uint64_t sm4_file_chunks(uint64_t plainSize, uint32_t chunkSize);
+
+// ܺļ
+uint64_t sm4_file_size(uint64_t plainSize, uint32_t chunkSize);
+
+// ļͷħ汾СļȲʱ false
+bool sm4_file_parse_header(const uint8_t* data, size_t length, SM4FileHeader& header);
+
+// ļoutput Ϊ sm4_file_size ֽڣֱӴ input д output ĶӦλ
+// header.nonce ÿļ벻ͬɣthreads Ϊ 0 ʱʹ̳߳صȫ߳
+void sm4_file_encrypt(const SM4Key& key, const SM4FileHeader& header,
+    const uint8_t* input, uint8_t* output, unsigned threads = 0);
+
+// ļoutput Ϊ plainSize ֽڣ sm4_file_parse_header ȡã
+// ļͷЧκһ֤ʧʱ falseʱ output ݲʹ
+bool sm4_file_decrypt(const SM4Key& key, const uint8_t* input, size_t length,
+    uint8_t* output, unsigned threads = 0);
+
+// ȡ [offset, offset + count)ֻǸĿ飬
+// ָǵĿȶ GHASH ֻ֤Ҫķ
+// Խ硢ļͷЧ֤ʧʱ falseoutput дδ֤
+bool sm4_file_read(const SM4Key& key, const uint8_t* input, size_t length,
+    uint64_t offset, size_t count, uint8_t* output);
+
+#endif // SM4_FILE_H
@@ -0,0 +1,50 @@
+#ifndef SM4_INTERNAL_H
+#define SM4_INTERNAL_H
+#include <cstdint>
+#include <cstddef>
+#include "sm4.h"
+
+// ڲõĸ sm4.cpp ʵ֣ڹӿ
+// SM4Engineֿļʽзּ GHASH ģͨ︴ͬһݼǩ㣬
+// ޸ GCM ıǩɻȽʱֻҪ sm4.cpp һ
+namespace sm4internal {
+
+    // GCM Ϣޣ2^32 - 2 
+    const uint64_t kGcmMaxBytes = ((1ull << 32) - 2) * 16;
+
+    // 32λ˶д
+    inline uint32_t load_be32(const uint8_t* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+    }
+
+    inline void store_be32(uint8_t* p, uint32_t v) {
+        p[0] = static_cast<uint8_t>(v >> 24);
+        p[1] = static_cast<uint8_t>(v >> 16);
+        p[2] = static_cast<uint8_t>(v >> 8);
+        p[3] = static_cast<uint8_t>(v);
+    }
+
+    // 128λ˼ n
+    void counter_add(uint8_t* counter, uint64_t n);
+
+    // ʱȽϣʱ޹
+    bool tag_equal(const uint8_t* a, const uint8_t* b, size_t length);
+
+    //  sm4_ctr_crypt ͬͳƣѰԼģʽ GCM¼ֽ
+    void ctr_crypt(const SM4Key& key, const uint8_t* counter,
+        const uint8_t* input, size_t length, uint8_t* output, unsigned threads);
+
+    //  block ݷ飨 0 ʼ GCM 飺J0 ǰ 12 ֽ || (J0  32 λ + 1 + block)
+    void gcm_counter(const uint8_t* J0, uint64_t block, uint8_t* counter);
+
+    // GCM βX Ϊ AAD ģĩβ㣩 GHASH ״̬
+    // ճȷ飬ǩ = GHASH ^ E(J0)X ֮
+    void gcm_finish(const SM4Key& key, const uint8_t* J0, uint8_t* X,
+        uint64_t aad_len, uint64_t length, uint8_t* tag);
+
+    // gcm_finish  tag ǰ tag_len ֽʱȽϣƥʱǩ֤ʧ
+    bool gcm_verify(const SM4Key& key, const uint8_t* J0, uint8_t* X,
+        uint64_t aad_len, uint64_t length, const uint8_t* tag, size_t tag_len);
+}
+
+#endif // SM4_INTERNAL_H
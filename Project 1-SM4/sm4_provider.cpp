@@ -0,0 +1,766 @@
+// SM4  OpenSSL 3 providerSM4-ECBSM4-CBCSM4-CTRSM4-GCMSM4-XTS
+//
+// Ϊɼģʹ EVP ӿڵĳ޸Ĵ뼴ɸñĶںˣ cpuid ѡĺˣ
+//   openssl enc -provider-path . -provider sm4prov -provider default -propquery provider=sm4prov -sm4-cbc ...
+//   openssl speed -provider-path . -provider sm4prov -provider default -propquery provider=sm4prov -evp SM4-GCM
+// Ҳ openssl.cnf  [provider_sect] м sm4prov = sm4prov_sect  module ·ȫá
+//
+//  OpenSSL õʵһ£
+// - ECB/CBC Ĭʹ PKCS#7 䣬 EVP_CIPHER_CTX_set_padding رգCTR Ϊ 128 λ˼
+// - GCM  update  out Ϊ NULL ʱ AADIV ȿͨ EVP_CTRL_AEAD_SET_IVLEN ãĬ 12
+//   final ֮µ IV ܼ IV  init ظʹþ IV
+//   ܽ EVP_CTRL_AEAD_GET_TAG ȡǩʱ final ֮ǰ EVP_CTRL_AEAD_SET_TAG ô֤ıǩ
+// - XTS ԿΪ 32 ֽڣԿ || ֵԿIV Ϊ 16 ֽڵֵÿ update һݵԪ
+#include "sm4.h"
+#include "sm4_drbg.h"
+#include <openssl/core.h>
+#include <openssl/core_dispatch.h>
+#include <openssl/core_names.h>
+#include <openssl/evp.h>
+#include <openssl/params.h>
+#include <cstdarg>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+    //-------------provider --------------
+
+    // ԭprovider ڲţ get_reason_strings ṩ֣
+    enum Reason {
+        REASON_INVALID_KEY_LENGTH = 1,
+        REASON_INVALID_IV_LENGTH,
+        REASON_INVALID_TAG_LENGTH,
+        REASON_OUTPUT_BUFFER_TOO_SMALL,
+        REASON_WRONG_FINAL_BLOCK_LENGTH,
+        REASON_BAD_DECRYPT,
+        REASON_NO_KEY_SET,
+        REASON_NO_IV_SET,
+        REASON_TAG_NOT_SET,
+        REASON_XTS_DUPLICATED_KEYS,
+        REASON_XTS_DATA_UNIT_TOO_SHORT,
+        REASON_AAD_AFTER_DATA,
+        REASON_UPDATE_AFTER_FINAL,
+        REASON_OPERATION_FAILED
+    };
+
+    const OSSL_ITEM kReasonStrings[] = {
+        { REASON_INVALID_KEY_LENGTH, (void*)"invalid key length" },
+        { REASON_INVALID_IV_LENGTH, (void*)"invalid iv length" },
+        { REASON_INVALID_TAG_LENGTH, (void*)"invalid tag length" },
+        { REASON_OUTPUT_BUFFER_TOO_SMALL, (void*)"output buffer too small" },
+        { REASON_WRONG_FINAL_BLOCK_LENGTH, (void*)"wrong final block length" },
+        { REASON_BAD_DECRYPT, (void*)"bad decrypt" },
+        { REASON_NO_KEY_SET, (void*)"no key set" },
+        { REASON_NO_IV_SET, (void*)"no iv set" },
+        { REASON_TAG_NOT_SET, (void*)"tag not set" },
+        { REASON_XTS_DUPLICATED_KEYS, (void*)"xts duplicated keys" },
+        { REASON_XTS_DATA_UNIT_TOO_SHORT, (void*)"xts data unit shorter than one block" },
+        { REASON_AAD_AFTER_DATA, (void*)"aad must be set before data" },
+        { REASON_UPDATE_AFTER_FINAL, (void*)"update or final after final, set a new iv" },
+        { REASON_OPERATION_FAILED, (void*)"operation failed" },
+        { 0, nullptr }
+    };
+
+    struct ProvCtx {
+        const OSSL_CORE_HANDLE* handle;
+        OSSL_FUNC_core_new_error_fn* newError;
+        OSSL_FUNC_core_set_error_debug_fn* setErrorDebug;
+        OSSL_FUNC_core_vset_error_fn* vsetError;
+    };
+
+    void raise_error(const ProvCtx* prov, int reason, const char* func, int line, ...) {
+        if (!prov || !prov->newError || !prov->setErrorDebug || !prov->vsetError) return;
+        prov->newError(prov->handle);
+        prov->setErrorDebug(prov->handle, __FILE__, line, func);
+        va_list args;
+        va_start(args, line);
+        prov->vsetError(prov->handle, static_cast<uint32_t>(reason), nullptr, args);
+        va_end(args);
+    }
+
+#define RAISE(ctx, reason) raise_error((ctx)->prov, (reason), __func__, __LINE__)
+
+    //-------------㷨--------------
+
+    enum CipherMode { MODE_ECB, MODE_CBC, MODE_CTR, MODE_GCM, MODE_XTS };
+
+    struct CipherInfo {
+        CipherMode mode;
+        unsigned evpMode;
+        size_t keyLength;
+        size_t ivLength;
+        size_t blockSize;   // ģʽΪ 1
+        bool aead;
+    };
+
+    const CipherInfo kEcb = { MODE_ECB, EVP_CIPH_ECB_MODE, 16, 0, 16, false };
+    const CipherInfo kCbc = { MODE_CBC, EVP_CIPH_CBC_MODE, 16, 16, 16, false };
+    const CipherInfo kCtr = { MODE_CTR, EVP_CIPH_CTR_MODE, 16, 16, 1, false };
+    const CipherInfo kGcm = { MODE_GCM, EVP_CIPH_GCM_MODE, 16, 12, 1, true };
+    const CipherInfo kXts = { MODE_XTS, EVP_CIPH_XTS_MODE, 32, 16, 1, false };
+
+    //-------------ӽ--------------
+
+    // Կֻdupctx ƳԭĹ
+    struct CipherCtx {
+        const ProvCtx* prov;
+        const CipherInfo* info;
+        bool encrypting = true;
+        bool padding = true;
+
+        std::shared_ptr<const SM4Key> key;
+        std::shared_ptr<const SM4Key> tweakKey;  // XTS
+        uint8_t iv[16] = { 0 };
+        size_t ivLength;
+        bool ivSet = false;
+
+        // ECB/CBC/CTRʽģԼδֽڼ
+        std::unique_ptr<SM4Context> stream;
+        size_t pending = 0;
+
+        // GCMIV 㳤
+        //  OpenSSL  GCM  iv_state ͬfinal ֮ IV Ϊã
+        // ֱµ IV ֮ǰܾ update/finalֻԿ򲻴 IV  init ʹþ IV
+        std::unique_ptr<SM4GcmContext> gcm;
+        uint8_t gcmIv[64] = { 0 };
+        uint8_t tag[16] = { 0 };
+        size_t tagLength = 16;
+        bool tagSet = false;
+        bool dataStarted = false;
+        bool finished = false;
+
+        CipherCtx(const ProvCtx* prov, const CipherInfo* info)
+            : prov(prov), info(info), ivLength(info->ivLength) {}
+
+        CipherCtx(const CipherCtx& other)
+            : prov(other.prov), info(other.info), encrypting(other.encrypting), padding(other.padding),
+              key(other.key), tweakKey(other.tweakKey), ivLength(other.ivLength), ivSet(other.ivSet),
+              pending(other.pending), tagLength(other.tagLength), tagSet(other.tagSet),
+              dataStarted(other.dataStarted), finished(other.finished) {
+            memcpy(iv, other.iv, sizeof(iv));
+            memcpy(gcmIv, other.gcmIv, sizeof(gcmIv));
+            memcpy(tag, other.tag, sizeof(tag));
+            if (other.stream) stream.reset(new SM4Context(*other.stream));
+            if (other.gcm) gcm.reset(new SM4GcmContext(*other.gcm));
+        }
+
+        ~CipherCtx() {
+            OPENSSL_cleanse(iv, sizeof(iv));
+            OPENSSL_cleanse(tag, sizeof(tag));
+        }
+
+        // Կ IV ֮ʼһµ
+        void restart() {
+            pending = 0;
+            dataStarted = false;
+            if (!key) return;
+            switch (info->mode) {
+            case MODE_ECB:
+            case MODE_CBC:
+            case MODE_CTR: {
+                SM4::Mode m = info->mode == MODE_ECB ? SM4::ECB : info->mode == MODE_CBC ? SM4::CBC : SM4::CTR;
+                if (!stream) stream.reset(new SM4Context(*key, m, iv));
+                else stream->setIV(iv);
+                stream->init(encrypting);
+                stream->setPadding(padding);
+                break;
+            }
+            case MODE_GCM:
+                if (!ivSet || finished) break;
+                if (!gcm) gcm.reset(new SM4GcmContext(*key));
+                gcm->init(gcmIv, ivLength, encrypting);
+                break;
+            case MODE_XTS:
+                break;
+            }
+        }
+    };
+
+    int set_ctx_params(void* vctx, const OSSL_PARAM params[]);
+
+    int cipher_init(CipherCtx* ctx, bool encrypt, const unsigned char* key, size_t keyLength,
+        const unsigned char* iv, size_t ivLength, const OSSL_PARAM params[])
+    {
+        ctx->encrypting = encrypt;
+        ctx->tagSet = false;
+        if (!set_ctx_params(ctx, params)) return 0;
+
+        if (iv && ctx->info->ivLength > 0) {
+            if (ivLength != ctx->ivLength) {
+                RAISE(ctx, REASON_INVALID_IV_LENGTH);
+                return 0;
+            }
+            if (ctx->info->mode == MODE_GCM) {
+                memcpy(ctx->gcmIv, iv, ivLength);
+                ctx->finished = false;
+            }
+            else {
+                memcpy(ctx->iv, iv, ivLength);
+            }
+            ctx->ivSet = true;
+        }
+
+        if (key) {
+            if (keyLength != ctx->info->keyLength) {
+                RAISE(ctx, REASON_INVALID_KEY_LENGTH);
+                return 0;
+            }
+            if (ctx->info->mode == MODE_XTS) {
+                //  OpenSSL  XTS ʵͬʱܾͬԿ
+                if (encrypt && CRYPTO_memcmp(key, key + 16, 16) == 0) {
+                    RAISE(ctx, REASON_XTS_DUPLICATED_KEYS);
+                    return 0;
+                }
+                ctx->tweakKey = std::make_shared<const SM4Key>(key + 16);
+            }
+            ctx->key = std::make_shared<const SM4Key>(key);
+            ctx->stream.reset();
+            ctx->gcm.reset();
+        }
+        ctx->restart();
+        return 1;
+    }
+
+    //-------------ַ--------------
+
+    template <const CipherInfo& Info>
+    void* newctx(void* provctx) {
+        return new (std::nothrow) CipherCtx(static_cast<const ProvCtx*>(provctx), &Info);
+    }
+
+    void freectx(void* vctx) {
+        delete static_cast<CipherCtx*>(vctx);
+    }
+
+    void* dupctx(void* vctx) {
+        try {
+            return new CipherCtx(*static_cast<CipherCtx*>(vctx));
+        }
+        catch (...) {
+            return nullptr;
+        }
+    }
+
+    int encrypt_init(void* vctx, const unsigned char* key, size_t keylen,
+        const unsigned char* iv, size_t ivlen, const OSSL_PARAM params[])
+    {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        try {
+            return cipher_init(ctx, true, key, keylen, iv, ivlen, params);
+        }
+        catch (...) {
+            RAISE(ctx, REASON_OPERATION_FAILED);
+            return 0;
+        }
+    }
+
+    int decrypt_init(void* vctx, const unsigned char* key, size_t keylen,
+        const unsigned char* iv, size_t ivlen, const OSSL_PARAM params[])
+    {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        try {
+            return cipher_init(ctx, false, key, keylen, iv, ivlen, params);
+        }
+        catch (...) {
+            RAISE(ctx, REASON_OPERATION_FAILED);
+            return 0;
+        }
+    }
+
+    // Կ IV Ƿ
+    bool ready(CipherCtx* ctx) {
+        if (!ctx->key) {
+            RAISE(ctx, REASON_NO_KEY_SET);
+            return false;
+        }
+        if (ctx->info->ivLength > 0 && !ctx->ivSet) {
+            RAISE(ctx, REASON_NO_IV_SET);
+            return false;
+        }
+        if (ctx->info->mode == MODE_GCM && ctx->finished) {
+            RAISE(ctx, REASON_UPDATE_AFTER_FINAL);
+            return false;
+        }
+        return true;
+    }
+
+    int cipher_update(CipherCtx* ctx, unsigned char* out, size_t* outl, size_t outsize,
+        const unsigned char* in, size_t inl)
+    {
+        if (!ready(ctx)) return 0;
+        *outl = 0;
+
+        switch (ctx->info->mode) {
+        case MODE_ECB:
+        case MODE_CBC: {
+            // ѻ뱾֮͵鲿
+            size_t maximum = (ctx->pending + inl) / 16 * 16;
+            if (outsize < maximum) {
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            size_t written = ctx->stream->update(in, inl, out);
+            ctx->pending = ctx->pending + inl - written;
+            *outl = written;
+            return 1;
+        }
+        case MODE_CTR:
+            if (outsize < inl) {
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            ctx->stream->ctrCrypt(in, inl, out);
+            *outl = inl;
+            return 1;
+        case MODE_GCM:
+            if (!out) {
+                if (ctx->dataStarted) {
+                    RAISE(ctx, REASON_AAD_AFTER_DATA);
+                    return 0;
+                }
+                ctx->gcm->setAAD(in, inl);
+                *outl = inl;
+                return 1;
+            }
+            if (outsize < inl) {
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            ctx->dataStarted = true;
+            ctx->gcm->update(in, inl, out);
+            *outl = inl;
+            return 1;
+        case MODE_XTS:
+            if (inl < 16) {
+                RAISE(ctx, REASON_XTS_DATA_UNIT_TOO_SHORT);
+                return 0;
+            }
+            if (outsize < inl) {
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            if (ctx->encrypting) sm4_xts_encrypt(*ctx->key, *ctx->tweakKey, ctx->iv, in, inl, out);
+            else sm4_xts_decrypt(*ctx->key, *ctx->tweakKey, ctx->iv, in, inl, out);
+            *outl = inl;
+            return 1;
+        }
+        return 0;
+    }
+
+    int update(void* vctx, unsigned char* out, size_t* outl, size_t outsize,
+        const unsigned char* in, size_t inl)
+    {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        if (inl == 0) {
+            *outl = 0;
+            return 1;
+        }
+        try {
+            return cipher_update(ctx, out, outl, outsize, in, inl);
+        }
+        catch (...) {
+            RAISE(ctx, REASON_OPERATION_FAILED);
+            return 0;
+        }
+    }
+
+    int cipher_final(CipherCtx* ctx, unsigned char* out, size_t* outl, size_t outsize) {
+        if (!ready(ctx)) return 0;
+        *outl = 0;
+
+        switch (ctx->info->mode) {
+        case MODE_ECB:
+        case MODE_CBC: {
+            if (ctx->encrypting && ctx->padding && outsize < 16) {
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            // ʱ final  15 ֽڣдջϣУͨٸ
+            uint8_t block[16];
+            bool aligned = ctx->padding ? ctx->encrypting || ctx->pending == 16 : ctx->pending == 0;
+            size_t n;
+            try {
+                n = ctx->stream->final(block);
+            }
+            catch (const std::runtime_error&) {
+                ctx->pending = 0;
+                RAISE(ctx, aligned ? REASON_BAD_DECRYPT : REASON_WRONG_FINAL_BLOCK_LENGTH);
+                return 0;
+            }
+            ctx->pending = 0;
+            if (outsize < n) {
+                OPENSSL_cleanse(block, sizeof(block));
+                RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                return 0;
+            }
+            memcpy(out, block, n);
+            OPENSSL_cleanse(block, sizeof(block));
+            *outl = n;
+            return 1;
+        }
+        case MODE_CTR:
+        case MODE_XTS:
+            return 1;
+        case MODE_GCM:
+            if (ctx->encrypting) {
+                ctx->gcm->finish(ctx->tag, 16);
+                ctx->tagSet = true;
+                ctx->finished = true;
+                return 1;
+            }
+            if (!ctx->tagSet) {
+                RAISE(ctx, REASON_TAG_NOT_SET);
+                return 0;
+            }
+            ctx->finished = true;
+            if (!ctx->gcm->verify(ctx->tag, ctx->tagLength)) {
+                RAISE(ctx, REASON_BAD_DECRYPT);
+                return 0;
+            }
+            return 1;
+        }
+        return 0;
+    }
+
+    int final(void* vctx, unsigned char* out, size_t* outl, size_t outsize) {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        try {
+            return cipher_final(ctx, out, outl, outsize);
+        }
+        catch (...) {
+            RAISE(ctx, REASON_OPERATION_FAILED);
+            return 0;
+        }
+    }
+
+    // EVP_CipherECB/CBC 뻺棬飻GCM  in Ϊ NULL ʱϢ
+    int cipher(void* vctx, unsigned char* out, size_t* outl, size_t outsize,
+        const unsigned char* in, size_t inl)
+    {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        try {
+            if (!ready(ctx)) return 0;
+            switch (ctx->info->mode) {
+            case MODE_ECB:
+            case MODE_CBC:
+                if (inl % 16 != 0) {
+                    RAISE(ctx, REASON_WRONG_FINAL_BLOCK_LENGTH);
+                    return 0;
+                }
+                if (outsize < inl) {
+                    RAISE(ctx, REASON_OUTPUT_BUFFER_TOO_SMALL);
+                    return 0;
+                }
+                if (ctx->encrypting) ctx->stream->encryptBlocks(in, inl, out);
+                else ctx->stream->decryptBlocks(in, inl, out);
+                *outl = inl;
+                return 1;
+            case MODE_GCM:
+                if (!in) return cipher_final(ctx, out, outl, outsize);
+                return cipher_update(ctx, out, outl, outsize, in, inl);
+            default:
+                return cipher_update(ctx, out, outl, outsize, in, inl);
+            }
+        }
+        catch (...) {
+            RAISE(ctx, REASON_OPERATION_FAILED);
+            return 0;
+        }
+    }
+
+    //---------------------------
+
+    template <const CipherInfo& Info>
+    int get_params(OSSL_PARAM params[]) {
+        OSSL_PARAM* p;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_MODE)) && !OSSL_PARAM_set_uint(p, Info.evpMode)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) && !OSSL_PARAM_set_size_t(p, Info.keyLength)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) && !OSSL_PARAM_set_size_t(p, Info.ivLength)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_BLOCK_SIZE)) && !OSSL_PARAM_set_size_t(p, Info.blockSize)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD)) && !OSSL_PARAM_set_int(p, Info.aead)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CUSTOM_IV)) && !OSSL_PARAM_set_int(p, Info.aead)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_CTS)) && !OSSL_PARAM_set_int(p, 0)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK)) && !OSSL_PARAM_set_int(p, 0)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_HAS_RAND_KEY)) && !OSSL_PARAM_set_int(p, 1)) return 0;
+        return 1;
+    }
+
+    const OSSL_PARAM kGettableParams[] = {
+        OSSL_PARAM_uint(OSSL_CIPHER_PARAM_MODE, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_BLOCK_SIZE, nullptr),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_AEAD, nullptr),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_CUSTOM_IV, nullptr),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_CTS, nullptr),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_TLS1_MULTIBLOCK, nullptr),
+        OSSL_PARAM_int(OSSL_CIPHER_PARAM_HAS_RAND_KEY, nullptr),
+        OSSL_PARAM_END
+    };
+
+    const OSSL_PARAM* gettable_params(void*) {
+        return kGettableParams;
+    }
+
+    int get_ctx_params(void* vctx, OSSL_PARAM params[]) {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        OSSL_PARAM* p;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_KEYLEN)) && !OSSL_PARAM_set_size_t(p, ctx->info->keyLength)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IVLEN)) && !OSSL_PARAM_set_size_t(p, ctx->ivLength)) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_PADDING)) && !OSSL_PARAM_set_uint(p, ctx->padding)) return 0;
+
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_IV)) != nullptr) {
+            const uint8_t* iv = ctx->info->mode == MODE_GCM ? ctx->gcmIv : ctx->iv;
+            if (p->data_size < ctx->ivLength) {
+                RAISE(ctx, REASON_INVALID_IV_LENGTH);
+                return 0;
+            }
+            if (!OSSL_PARAM_set_octet_string(p, iv, ctx->ivLength) && !OSSL_PARAM_set_octet_ptr(p, iv, ctx->ivLength)) {
+                return 0;
+            }
+        }
+
+        //  EVP_CIPHER_CTX_rand_key ʹãɱ CTR_DRBG 
+        // EVP  EVP_CTRL_RAND_KEY  data_size Ϊ 0 DES ͬʱԿֱд
+        if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_RANDOM_KEY)) != nullptr) {
+            size_t n = ctx->info->keyLength;
+            if (p->data_type != OSSL_PARAM_OCTET_STRING || !p->data || (p->data_size != 0 && p->data_size < n)) {
+                RAISE(ctx, REASON_INVALID_KEY_LENGTH);
+                return 0;
+            }
+            uint8_t* key = static_cast<uint8_t*>(p->data);
+            try {
+                do {
+                    sm4_random_bytes(key, n);
+                } while (ctx->info->mode == MODE_XTS && CRYPTO_memcmp(key, key + 16, 16) == 0);
+            }
+            catch (...) {
+                RAISE(ctx, REASON_OPERATION_FAILED);
+                return 0;
+            }
+            p->return_size = n;
+        }
+
+        if (ctx->info->mode == MODE_GCM) {
+            if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAGLEN)) && !OSSL_PARAM_set_size_t(p, ctx->tagLength)) return 0;
+            if ((p = OSSL_PARAM_locate(params, OSSL_CIPHER_PARAM_AEAD_TAG)) != nullptr) {
+                // ֻмܽȡǩΪ 12~16 ʱȡǩǰֽ
+                if (!ctx->encrypting || !ctx->tagSet || p->data_size < SM4GcmContext::MIN_TAG_LENGTH || p->data_size > 16) {
+                    RAISE(ctx, REASON_INVALID_TAG_LENGTH);
+                    return 0;
+                }
+                if (!OSSL_PARAM_set_octet_string(p, ctx->tag, p->data_size)) return 0;
+            }
+        }
+        return 1;
+    }
+
+    const OSSL_PARAM kGettableCtxParams[] = {
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, nullptr),
+        OSSL_PARAM_uint(OSSL_CIPHER_PARAM_PADDING, nullptr),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_IV, nullptr, 0),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_RANDOM_KEY, nullptr, 0),
+        OSSL_PARAM_END
+    };
+
+    const OSSL_PARAM kGcmGettableCtxParams[] = {
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_IVLEN, nullptr),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_IV, nullptr, 0),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_RANDOM_KEY, nullptr, 0),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_TAGLEN, nullptr),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, nullptr, 0),
+        OSSL_PARAM_END
+    };
+
+    template <const CipherInfo& Info>
+    const OSSL_PARAM* gettable_ctx_params(void*, void*) {
+        return Info.aead ? kGcmGettableCtxParams : kGettableCtxParams;
+    }
+
+    int set_ctx_params(void* vctx, const OSSL_PARAM params[]) {
+        CipherCtx* ctx = static_cast<CipherCtx*>(vctx);
+        if (!params) return 1;
+        const OSSL_PARAM* p;
+
+        if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_KEYLEN)) != nullptr) {
+            size_t keyLength;
+            if (!OSSL_PARAM_get_size_t(p, &keyLength) || keyLength != ctx->info->keyLength) {
+                RAISE(ctx, REASON_INVALID_KEY_LENGTH);
+                return 0;
+            }
+        }
+
+        if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_PADDING)) != nullptr) {
+            unsigned int padding;
+            if (!OSSL_PARAM_get_uint(p, &padding)) return 0;
+            ctx->padding = padding != 0;
+            if (ctx->stream) ctx->stream->setPadding(ctx->padding);
+        }
+
+        if (ctx->info->mode != MODE_GCM) return 1;
+
+        if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_IVLEN)) != nullptr) {
+            size_t ivLength;
+            if (!OSSL_PARAM_get_size_t(p, &ivLength) || ivLength == 0 || ivLength > sizeof(ctx->gcmIv)) {
+                RAISE(ctx, REASON_INVALID_IV_LENGTH);
+                return 0;
+            }
+            ctx->ivLength = ivLength;
+            ctx->ivSet = false;
+        }
+
+        // ǰô֤ıǩʱֻóȣdata Ϊ NULL
+        if ((p = OSSL_PARAM_locate_const(params, OSSL_CIPHER_PARAM_AEAD_TAG)) != nullptr) {
+            if (p->data_type != OSSL_PARAM_OCTET_STRING || p->data_size < SM4GcmContext::MIN_TAG_LENGTH || p->data_size > 16) {
+                RAISE(ctx, REASON_INVALID_TAG_LENGTH);
+                return 0;
+            }
+            if (p->data) {
+                if (ctx->encrypting) {
+                    RAISE(ctx, REASON_INVALID_TAG_LENGTH);
+                    return 0;
+                }
+                memcpy(ctx->tag, p->data, p->data_size);
+                ctx->tagSet = true;
+            }
+            ctx->tagLength = p->data_size;
+        }
+        return 1;
+    }
+
+    const OSSL_PARAM kSettableCtxParams[] = {
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, nullptr),
+        OSSL_PARAM_uint(OSSL_CIPHER_PARAM_PADDING, nullptr),
+        OSSL_PARAM_END
+    };
+
+    const OSSL_PARAM kGcmSettableCtxParams[] = {
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_KEYLEN, nullptr),
+        OSSL_PARAM_size_t(OSSL_CIPHER_PARAM_AEAD_IVLEN, nullptr),
+        OSSL_PARAM_octet_string(OSSL_CIPHER_PARAM_AEAD_TAG, nullptr, 0),
+        OSSL_PARAM_END
+    };
+
+    template <const CipherInfo& Info>
+    const OSSL_PARAM* settable_ctx_params(void*, void*) {
+        return Info.aead ? kGcmSettableCtxParams : kSettableCtxParams;
+    }
+
+    //-------------ַ--------------
+
+    typedef void (*Func)(void);
+
+    template <const CipherInfo& Info>
+    struct CipherDispatch {
+        static const OSSL_DISPATCH table[];
+    };
+
+    template <const CipherInfo& Info>
+    const OSSL_DISPATCH CipherDispatch<Info>::table[] = {
+        { OSSL_FUNC_CIPHER_NEWCTX, (Func)newctx<Info> },
+        { OSSL_FUNC_CIPHER_FREECTX, (Func)freectx },
+        { OSSL_FUNC_CIPHER_DUPCTX, (Func)dupctx },
+        { OSSL_FUNC_CIPHER_ENCRYPT_INIT, (Func)encrypt_init },
+        { OSSL_FUNC_CIPHER_DECRYPT_INIT, (Func)decrypt_init },
+        { OSSL_FUNC_CIPHER_UPDATE, (Func)update },
+        { OSSL_FUNC_CIPHER_FINAL, (Func)final },
+        { OSSL_FUNC_CIPHER_CIPHER, (Func)cipher },
+        { OSSL_FUNC_CIPHER_GET_PARAMS, (Func)get_params<Info> },
+        { OSSL_FUNC_CIPHER_GETTABLE_PARAMS, (Func)gettable_params },
+        { OSSL_FUNC_CIPHER_GET_CTX_PARAMS, (Func)get_ctx_params },
+        { OSSL_FUNC_CIPHER_GETTABLE_CTX_PARAMS, (Func)gettable_ctx_params<Info> },
+        { OSSL_FUNC_CIPHER_SET_CTX_PARAMS, (Func)set_ctx_params },
+        { OSSL_FUNC_CIPHER_SETTABLE_CTX_PARAMS, (Func)settable_ctx_params<Info> },
+        { 0, nullptr }
+    };
+
+    //  OpenSSL ʵͬ OIDͨ provider=sm4prov 
+    const OSSL_ALGORITHM kCiphers[] = {
+        { "SM4-ECB:1.2.156.10197.1.104.1", "provider=sm4prov", CipherDispatch<kEcb>::table, "SM4 ECB" },
+        { "SM4-CBC:SM4:1.2.156.10197.1.104.2", "provider=sm4prov", CipherDispatch<kCbc>::table, "SM4 CBC" },
+        { "SM4-CTR:1.2.156.10197.1.104.7", "provider=sm4prov", CipherDispatch<kCtr>::table, "SM4 CTR" },
+        { "SM4-GCM:1.2.156.10197.1.104.8", "provider=sm4prov", CipherDispatch<kGcm>::table, "SM4 GCM" },
+        { "SM4-XTS:1.2.156.10197.1.104.10.1", "provider=sm4prov", CipherDispatch<kXts>::table, "SM4 XTS (IEEE 1619)" },
+        { nullptr, nullptr, nullptr, nullptr }
+    };
+
+    //-------------provider --------------
+
+    const OSSL_PARAM kProviderGettableParams[] = {
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_NAME, nullptr, 0),
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_VERSION, nullptr, 0),
+        OSSL_PARAM_utf8_ptr(OSSL_PROV_PARAM_BUILDINFO, nullptr, 0),
+        OSSL_PARAM_int(OSSL_PROV_PARAM_STATUS, nullptr),
+        OSSL_PARAM_END
+    };
+
+    const OSSL_PARAM* provider_gettable_params(void*) {
+        return kProviderGettableParams;
+    }
+
+    // buildinfo Ϊǰ CPU ѡеĺ
+    int provider_get_params(void*, OSSL_PARAM params[]) {
+        static const uint8_t zero[16] = { 0 };
+        static const std::string backend = SM4Key(zero).backendName();
+        OSSL_PARAM* p;
+        if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_NAME)) && !OSSL_PARAM_set_utf8_ptr(p, "SM4 provider")) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_VERSION)) && !OSSL_PARAM_set_utf8_ptr(p, "1.0")) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_BUILDINFO)) && !OSSL_PARAM_set_utf8_ptr(p, backend.c_str())) return 0;
+        if ((p = OSSL_PARAM_locate(params, OSSL_PROV_PARAM_STATUS)) && !OSSL_PARAM_set_int(p, 1)) return 0;
+        return 1;
+    }
+
+    const OSSL_ALGORITHM* provider_query(void*, int operation, int* noCache) {
+        *noCache = 0;
+        return operation == OSSL_OP_CIPHER ? kCiphers : nullptr;
+    }
+
+    const OSSL_ITEM* provider_reason_strings(void*) {
+        return kReasonStrings;
+    }
+
+    void provider_teardown(void* provctx) {
+        delete static_cast<ProvCtx*>(provctx);
+    }
+
+    const OSSL_DISPATCH kProviderDispatch[] = {
+        { OSSL_FUNC_PROVIDER_TEARDOWN, (Func)provider_teardown },
+        { OSSL_FUNC_PROVIDER_GETTABLE_PARAMS, (Func)provider_gettable_params },
+        { OSSL_FUNC_PROVIDER_GET_PARAMS, (Func)provider_get_params },
+        { OSSL_FUNC_PROVIDER_QUERY_OPERATION, (Func)provider_query },
+        { OSSL_FUNC_PROVIDER_GET_REASON_STRINGS, (Func)provider_reason_strings },
+        { 0, nullptr }
+    };
+}
+
+extern "C" int OSSL_provider_init(const OSSL_CORE_HANDLE* handle, const OSSL_DISPATCH* in,
+    const OSSL_DISPATCH** out, void** provctx)
+{
+    ProvCtx* prov = new (std::nothrow) ProvCtx();
+    if (!prov) return 0;
+    prov->handle = handle;
+    for (; in->function_id != 0; in++) {
+        switch (in->function_id) {
+        case OSSL_FUNC_CORE_NEW_ERROR:
+            prov->newError = OSSL_FUNC_core_new_error(in);
+            break;
+        case OSSL_FUNC_CORE_SET_ERROR_DEBUG:
+            prov->setErrorDebug = OSSL_FUNC_core_set_error_debug(in);
+            break;
+        case OSSL_FUNC_CORE_VSET_ERROR:
+            prov->vsetError = OSSL_FUNC_core_vset_error(in);
+            break;
+        default:
+            break;
+        }
+    }
+    *out = kProviderDispatch;
+    *provctx = prov;
+    return 1;
+}
@@ -0,0 +1,624 @@
+#include "sm4_simd.h"
+#include <cstring>
+#include <immintrin.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace sm4simd {
+
+//-------------CPU Լ--------------------
+
+static void cpuid(uint32_t leaf, uint32_t sub, uint32_t r[4]) {
+#if defined(_MSC_VER)
+    int regs[4];
+    __cpuidex(regs, (int)leaf, (int)sub);
+    for (int i = 0; i < 4; i++) r[i] = (uint32_t)regs[i];
+#else
+    __cpuid_count(leaf, sub, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+// ȡ XCR0жϲϵͳǷ񱣴 ymm/zmm Ĵ
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static CpuFeatures detect() {
+    CpuFeatures f = {};
+    uint32_t r[4];
+    cpuid(0, 0, r);
+    uint32_t maxLeaf = r[0];
+    if (maxLeaf < 7) return f;
+
+    cpuid(1, 0, r);
+    f.pclmul = (r[2] >> 1) & 1;     // 128 λ SSE ָ AVX
+    bool osxsave = (r[2] >> 27) & 1;
+    bool avx = (r[2] >> 28) & 1;
+    if (!osxsave || !avx) return f;
+
+    uint64_t xcr0 = xgetbv0();
+    bool ymmState = (xcr0 & 0x06) == 0x06;
+    bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    f.aesni = (r[2] >> 25) & 1;
+
+    cpuid(7, 0, r);
+    f.gfni = (r[2] >> 8) & 1;
+    f.vpclmul = (r[2] >> 10) & 1;
+    f.avx2 = ymmState && ((r[1] >> 5) & 1);
+    f.avx512 = zmmState && ((r[1] >> 16) & 1) && ((r[1] >> 30) & 1);
+    return f;
+}
+
+const CpuFeatures& cpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+//---------------------------------
+
+//  bigWB 飩壬 smallWS 飩²֣
+//  WS βʱһ
+template <size_t WB, size_t WS, typename BigFn, typename SmallFn>
+static inline void runBatches(const uint8_t* in, uint8_t* out, size_t blocks, BigFn big, SmallFn small) {
+    size_t i = 0;
+    for (; i + WB <= blocks; i += WB) {
+        big(in + i * 16, out + i * 16);
+    }
+    for (; i + WS <= blocks; i += WS) {
+        small(in + i * 16, out + i * 16);
+    }
+    if (i < blocks) {
+        alignas(64) uint8_t tmp[WS * 16] = { 0 };
+        size_t rest = (blocks - i) * 16;
+        memcpy(tmp, in + i * 16, rest);
+        small(tmp, tmp);
+        memcpy(out + i * 16, tmp, rest);
+    }
+}
+
+// һںˣBATCH_G һν֯ G 飬BATCH_1 ֻһ飬
+// ֮û֯ڸ S б任ָӳ
+#define SM4_DEFINE_KERNEL(NAME, TARGET, BATCH_G, BATCH_1, WIDTH, G)                         \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, const uint32_t* table,                             \
+        const uint8_t* in, uint8_t* out, size_t blocks) {                                   \
+        runBatches<(WIDTH) * (G), (WIDTH)>(in, out, blocks,                                 \
+            [&](const uint8_t* src, uint8_t* dst) { BATCH_G(rk, table, src, dst); },        \
+            [&](const uint8_t* src, uint8_t* dst) { BATCH_1(rk, table, src, dst); });       \
+    }
+
+// ÿԿİ汾rk пΪ stride֮䰴ƫ
+#define SM4_DEFINE_LANES_KERNEL(NAME, TARGET, BATCH_G, BATCH_1, WIDTH, G)                   \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, size_t stride, const uint32_t* table,              \
+        const uint8_t* in, uint8_t* out, size_t blocks) {                                   \
+        size_t i = 0;                                                                       \
+        for (; i + (WIDTH) * (G) <= blocks; i += (WIDTH) * (G)) {                           \
+            BATCH_G(rk + i, stride, table, in + i * 16, out + i * 16);                      \
+        }                                                                                   \
+        for (; i + (WIDTH) <= blocks; i += (WIDTH)) {                                       \
+            BATCH_1(rk + i, stride, table, in + i * 16, out + i * 16);                      \
+        }                                                                                   \
+    }
+
+// Կչ໺ںͬȽ֯ G 飬µİһ鴦
+#define SM4_DEFINE_EXPAND_KERNEL(NAME, TARGET, BATCH_G, BATCH_1, WIDTH, G)                  \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* fk, const uint32_t* ck, const uint32_t* table,         \
+        const uint8_t* keys, uint32_t* rk, size_t stride, size_t count) {                   \
+        size_t i = 0;                                                                       \
+        for (; i + (WIDTH) * (G) <= count; i += (WIDTH) * (G)) {                            \
+            BATCH_G(fk, ck, table, keys + i * 16, rk + i, stride);                          \
+        }                                                                                   \
+        for (; i + (WIDTH) <= count; i += (WIDTH)) {                                        \
+            BATCH_1(fk, ck, table, keys + i * 16, rk + i, stride);                          \
+        }                                                                                   \
+    }
+
+//-------------AVX2ÿ 8 --------------------
+
+SM4_TARGET("avx2")
+static inline __m256i bswap32_avx2(__m256i x) {
+    const __m256i mask = _mm256_setr_epi8(
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+        3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+// ÿ 128 λͨ 4x4  32 λתã棩
+SM4_TARGET("avx2")
+static inline void transpose_avx2(__m256i& a, __m256i& b, __m256i& c, __m256i& d) {
+    __m256i t0 = _mm256_unpacklo_epi32(a, b);
+    __m256i t1 = _mm256_unpackhi_epi32(a, b);
+    __m256i t2 = _mm256_unpacklo_epi32(c, d);
+    __m256i t3 = _mm256_unpackhi_epi32(c, d);
+    a = _mm256_unpacklo_epi64(t0, t2);
+    b = _mm256_unpackhi_epi64(t0, t2);
+    c = _mm256_unpacklo_epi64(t1, t3);
+    d = _mm256_unpackhi_epi64(t1, t3);
+}
+
+//  8 飬תΪ X0..X3ÿĴ 8 ͬһ֣
+SM4_TARGET("avx2")
+static inline void load8_avx2(const uint8_t* in, __m256i x[4]) {
+    for (int j = 0; j < 4; j++) {
+        x[j] = bswap32_avx2(_mm256_loadu_si256((const __m256i*)(in + j * 32)));
+    }
+    transpose_avx2(x[0], x[1], x[2], x[3]);
+}
+
+// 任 R дأ (X35, X34, X33, X32)
+SM4_TARGET("avx2")
+static inline void store8_avx2(uint8_t* out, __m256i x[4]) {
+    transpose_avx2(x[3], x[2], x[1], x[0]);
+    for (int j = 0; j < 4; j++) {
+        _mm256_storeu_si256((__m256i*)(out + j * 32), bswap32_avx2(x[3 - j]));
+    }
+}
+
+SM4_TARGET("avx2")
+static inline __m256i rotl8_avx2(__m256i x) {
+    const __m256i rot8 = _mm256_setr_epi8(
+        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+        3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    return _mm256_shuffle_epi8(x, rot8);
+}
+
+// L(x) = x ^ (x <<< 24) ^ ((x ^ (x <<< 8) ^ (x <<< 16)) <<< 2)
+SM4_TARGET("avx2")
+static inline __m256i L_avx2(__m256i x) {
+    __m256i r8 = rotl8_avx2(x);
+    __m256i r16 = rotl8_avx2(r8);
+    __m256i r24 = rotl8_avx2(r16);
+    __m256i t = _mm256_xor_si256(_mm256_xor_si256(x, r8), r16);
+    t = _mm256_or_si256(_mm256_slli_epi32(t, 2), _mm256_srli_epi32(t, 30));
+    return _mm256_xor_si256(_mm256_xor_si256(x, r24), t);
+}
+
+// һֵx[A] ^= T(x[B] ^ x[C] ^ x[D] ^ rk)TFN(x, table) Ϊں˵ĺϳû T
+#define SM4_ROUND_AVX2(TFN, table, x, G, k, A, B, C, D)                                    \
+    for (int g = 0; g < (G); g++) {                                                         \
+        __m256i t = _mm256_xor_si256(_mm256_xor_si256(x[g][B], x[g][C]),                    \
+            _mm256_xor_si256(x[g][D], k));                                                  \
+        x[g][A] = _mm256_xor_si256(x[g][A], TFN(t, table));                                 \
+    }
+
+#define SM4_ROUNDS_AVX2(TFN, rk, table, x, G)                                               \
+    for (int i = 0; i < 32; i += 4) {                                                       \
+        __m256i k0 = _mm256_set1_epi32((int)(rk)[i + 0]);                                   \
+        __m256i k1 = _mm256_set1_epi32((int)(rk)[i + 1]);                                   \
+        __m256i k2 = _mm256_set1_epi32((int)(rk)[i + 2]);                                   \
+        __m256i k3 = _mm256_set1_epi32((int)(rk)[i + 3]);                                   \
+        SM4_ROUND_AVX2(TFN, table, x, G, k0, 0, 1, 2, 3)                                    \
+        SM4_ROUND_AVX2(TFN, table, x, G, k1, 1, 2, 3, 0)                                    \
+        SM4_ROUND_AVX2(TFN, table, x, G, k2, 2, 3, 0, 1)                                    \
+        SM4_ROUND_AVX2(TFN, table, x, G, k3, 3, 0, 1, 2)                                    \
+    }
+
+#define SM4_DEFINE_BATCH_AVX2(NAME, TARGET, TFN, G)                                         \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, const uint32_t* table, const uint8_t* in, uint8_t* out) { \
+        __m256i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) load8_avx2(in + g * 128, x[g]);                       \
+        SM4_ROUNDS_AVX2(TFN, rk, table, x, G)                                               \
+        for (int g = 0; g < (G); g++) store8_avx2(out + g * 128, x[g]);                     \
+    }
+
+//  8 ԵԿг load8_avx2 תúͬͨ˳
+//  128 λΪ 0/2/4/6 128 λΪ 1/3/5/7
+SM4_TARGET("avx2")
+static inline __m256i laneKeys_avx2(const uint32_t* rk) {
+    const __m256i order = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    return _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)rk), order);
+}
+
+#define SM4_ROUNDS_LANES_AVX2(TFN, rk, stride, table, x, G)                                \
+    for (int i = 0; i < 32; i += 4) {                                                       \
+        SM4_ROUND_AVX2(TFN, table, x, G, laneKeys_avx2(rk + (i + 0) * (stride) + g * 8), 0, 1, 2, 3) \
+        SM4_ROUND_AVX2(TFN, table, x, G, laneKeys_avx2(rk + (i + 1) * (stride) + g * 8), 1, 2, 3, 0) \
+        SM4_ROUND_AVX2(TFN, table, x, G, laneKeys_avx2(rk + (i + 2) * (stride) + g * 8), 2, 3, 0, 1) \
+        SM4_ROUND_AVX2(TFN, table, x, G, laneKeys_avx2(rk + (i + 3) * (stride) + g * 8), 3, 0, 1, 2) \
+    }
+
+#define SM4_DEFINE_LANES_BATCH_AVX2(NAME, TARGET, TFN, G)                                   \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, size_t stride, const uint32_t* table,              \
+        const uint8_t* in, uint8_t* out) {                                                  \
+        __m256i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) load8_avx2(in + g * 128, x[g]);                       \
+        SM4_ROUNDS_LANES_AVX2(TFN, rk, stride, table, x, G)                                 \
+        for (int g = 0; g < (G); g++) store8_avx2(out + g * 128, x[g]);                     \
+    }
+
+// L'(x) = x ^ (x <<< 13) ^ (x <<< 23)Կչ
+SM4_TARGET("avx2")
+static inline __m256i LPrime_avx2(__m256i x) {
+    __m256i r13 = _mm256_or_si256(_mm256_slli_epi32(x, 13), _mm256_srli_epi32(x, 19));
+    __m256i r23 = _mm256_or_si256(_mm256_slli_epi32(x, 23), _mm256_srli_epi32(x, 9));
+    return _mm256_xor_si256(_mm256_xor_si256(x, r13), r23);
+}
+
+// Կչһ֣K[A] ^= T'(K[B] ^ K[C] ^ K[D] ^ CK[i])µ K[A]  i ֵԿ
+//  laneKeys_avx2 лԭΪԿ˳д
+#define SM4_EXPAND_ROUND_AVX2(TFN, table, x, G, ck, i, rk, stride, A, B, C, D)             \
+    for (int g = 0; g < (G); g++) {                                                         \
+        const __m256i inv = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);                      \
+        __m256i t = _mm256_xor_si256(_mm256_xor_si256(x[g][B], x[g][C]),                    \
+            _mm256_xor_si256(x[g][D], _mm256_set1_epi32((int)(ck)[i])));                    \
+        x[g][A] = _mm256_xor_si256(x[g][A], TFN(t, table));                                 \
+        _mm256_storeu_si256((__m256i*)((rk) + (i) * (stride) + g * 8),                      \
+            _mm256_permutevar8x32_epi32(x[g][A], inv));                                     \
+    }
+
+#define SM4_DEFINE_EXPAND_BATCH_AVX2(NAME, TARGET, TFN, G)                                  \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* fk, const uint32_t* ck, const uint32_t* table,         \
+        const uint8_t* keys, uint32_t* rk, size_t stride) {                                 \
+        __m256i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) {                                                     \
+            load8_avx2(keys + g * 128, x[g]);                                               \
+            for (int j = 0; j < 4; j++) {                                                   \
+                x[g][j] = _mm256_xor_si256(x[g][j], _mm256_set1_epi32((int)fk[j]));         \
+            }                                                                               \
+        }                                                                                   \
+        for (int i = 0; i < 32; i += 4) {                                                   \
+            SM4_EXPAND_ROUND_AVX2(TFN, table, x, G, ck, i + 0, rk, stride, 0, 1, 2, 3)      \
+            SM4_EXPAND_ROUND_AVX2(TFN, table, x, G, ck, i + 1, rk, stride, 1, 2, 3, 0)      \
+            SM4_EXPAND_ROUND_AVX2(TFN, table, x, G, ck, i + 2, rk, stride, 2, 3, 0, 1)      \
+            SM4_EXPAND_ROUND_AVX2(TFN, table, x, G, ck, i + 3, rk, stride, 3, 0, 1, 2)      \
+        }                                                                                   \
+    }
+
+// ʵ֣T(x) = T[b0] ^ (T[b1] <<< 8) ^ (T[b2] <<< 16) ^ (T[b3] <<< 24)
+// L 任ѭλɽһ T ֽתɸ 4 ֽλã
+// L' ͬˣ T' õԿչ T'
+SM4_TARGET("avx2")
+static inline __m256i T_gather_avx2(__m256i x, const uint32_t* table) {
+    const int* t = reinterpret_cast<const int*>(table);
+    const __m256i m = _mm256_set1_epi32(0xff);
+    __m256i y3 = _mm256_i32gather_epi32(t, _mm256_srli_epi32(x, 24), 4);
+    __m256i y2 = _mm256_i32gather_epi32(t, _mm256_and_si256(_mm256_srli_epi32(x, 16), m), 4);
+    __m256i y1 = _mm256_i32gather_epi32(t, _mm256_and_si256(_mm256_srli_epi32(x, 8), m), 4);
+    __m256i y0 = _mm256_i32gather_epi32(t, _mm256_and_si256(x, m), 4);
+    // Horner ʽ((y3 <<< 8 ^ y2) <<< 8 ^ y1) <<< 8 ^ y0
+    __m256i y = _mm256_xor_si256(rotl8_avx2(y3), y2);
+    y = _mm256_xor_si256(rotl8_avx2(y), y1);
+    y = _mm256_xor_si256(rotl8_avx2(y), y0);
+    return y;
+}
+
+//-------------S еķͬ--------------------
+//
+// SM4  AES  S ж GF(2^8) ϵ任֮ͬ
+//  SM4  S пдɣ
+//     S(x) = Post * Inv_AES(Pre * x ^ cPre) ^ cPost
+// Pre/Post Ϊ 8x8 ؾ SM4 ķ任 A 0xd3 Լͬϲ
+// AES-NI · aesenclast һ AES 任Ѻϲ Post
+// 任ߵͰֽڲ 16 pshufb
+
+// x -> Pre * x ^ cPre
+static const uint64_t kPreLo[2] = { 0x078B37BB820EB23Eull, 0x9814A8241D912DA1ull };
+static const uint64_t kPreHi[2] = { 0x37EB19C5F22EDC00ull, 0x3FE311CDFA26D408ull };
+// aesenclast  -> SM4 S 
+static const uint64_t kPostLo[2] = { 0x2098EA521EA6D46Cull, 0x47FF8D3579C1B30Bull };
+static const uint64_t kPostHi[2] = { 0x2DCD7D9DB050E000ull, 0xED0DBD5D709020C0ull };
+// GFNI ķ󣨵 7-i ֽΪ i λӦУ
+static const uint64_t kGfniPre = 0x4C287DB91A22505Dull;
+static const int kGfniPreC = 0x3e;
+static const uint64_t kGfniPost = 0xF3AB34A974A6B589ull;
+static const int kGfniPostC = 0xd3;
+
+SM4_TARGET("avx2")
+static inline __m256i affine_avx2(__m256i x, const uint64_t lo[2], const uint64_t hi[2]) {
+    const __m256i m = _mm256_set1_epi8(0x0f);
+    __m256i tlo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)lo));
+    __m256i thi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)hi));
+    __m256i l = _mm256_shuffle_epi8(tlo, _mm256_and_si256(x, m));
+    __m256i h = _mm256_shuffle_epi8(thi, _mm256_and_si256(_mm256_srli_epi16(x, 4), m));
+    return _mm256_xor_si256(l, h);
+}
+
+//-------------AES-NI鹲 16 --------------------
+
+// aesenclast  ShiftRowsһ ShiftRows ʹֽλñֲ
+SM4_TARGET("avx2,aes")
+static inline __m256i S_aesni(__m256i x) {
+    const __m256i invShiftRows = _mm256_setr_epi8(
+        0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3,
+        0, 13, 10, 7, 4, 1, 14, 11, 8, 5, 2, 15, 12, 9, 6, 3);
+    x = affine_avx2(x, kPreLo, kPreHi);
+    x = _mm256_shuffle_epi8(x, invShiftRows);
+    __m128i lo = _mm_aesenclast_si128(_mm256_castsi256_si128(x), _mm_setzero_si128());
+    __m128i hi = _mm_aesenclast_si128(_mm256_extracti128_si256(x, 1), _mm_setzero_si128());
+    x = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    return affine_avx2(x, kPostLo, kPostHi);
+}
+
+SM4_TARGET("avx2,aes")
+static inline __m256i T_aesni(__m256i x, const uint32_t*) {
+    return L_avx2(S_aesni(x));
+}
+
+SM4_TARGET("avx2,aes")
+static inline __m256i TPrime_aesni(__m256i x, const uint32_t*) {
+    return LPrime_avx2(S_aesni(x));
+}
+
+//-------------GFNI + AVX2鹲 16 --------------------
+
+SM4_TARGET("avx2,gfni")
+static inline __m256i S_gfni_avx2(__m256i x) {
+    x = _mm256_gf2p8affine_epi64_epi8(x, _mm256_set1_epi64x((long long)kGfniPre), kGfniPreC);
+    return _mm256_gf2p8affineinv_epi64_epi8(x, _mm256_set1_epi64x((long long)kGfniPost), kGfniPostC);
+}
+
+SM4_TARGET("avx2,gfni")
+static inline __m256i T_gfni_avx2(__m256i x, const uint32_t*) {
+    return L_avx2(S_gfni_avx2(x));
+}
+
+SM4_TARGET("avx2,gfni")
+static inline __m256i TPrime_gfni_avx2(__m256i x, const uint32_t*) {
+    return LPrime_avx2(S_gfni_avx2(x));
+}
+
+SM4_DEFINE_BATCH_AVX2(batch8_gather_avx2, "avx2", T_gather_avx2, 1)
+SM4_DEFINE_KERNEL(crypt_gather_avx2, "avx2", batch8_gather_avx2, batch8_gather_avx2, 8, 1)
+SM4_DEFINE_LANES_BATCH_AVX2(lanes8_gather_avx2, "avx2", T_gather_avx2, 1)
+SM4_DEFINE_LANES_KERNEL(lanes_gather_avx2, "avx2", lanes8_gather_avx2, lanes8_gather_avx2, 8, 1)
+SM4_DEFINE_EXPAND_BATCH_AVX2(expand8_gather_avx2, "avx2", T_gather_avx2, 1)
+SM4_DEFINE_EXPAND_KERNEL(expand_gather_avx2, "avx2", expand8_gather_avx2, expand8_gather_avx2, 8, 1)
+
+SM4_DEFINE_BATCH_AVX2(batch8_aesni, "avx2,aes", T_aesni, 1)
+SM4_DEFINE_BATCH_AVX2(batch16_aesni, "avx2,aes", T_aesni, 2)
+SM4_DEFINE_KERNEL(crypt_aesni, "avx2,aes", batch16_aesni, batch8_aesni, 8, 2)
+SM4_DEFINE_LANES_BATCH_AVX2(lanes8_aesni, "avx2,aes", T_aesni, 1)
+SM4_DEFINE_LANES_BATCH_AVX2(lanes16_aesni, "avx2,aes", T_aesni, 2)
+SM4_DEFINE_LANES_KERNEL(lanes_aesni, "avx2,aes", lanes16_aesni, lanes8_aesni, 8, 2)
+SM4_DEFINE_EXPAND_BATCH_AVX2(expand8_aesni, "avx2,aes", TPrime_aesni, 1)
+SM4_DEFINE_EXPAND_BATCH_AVX2(expand16_aesni, "avx2,aes", TPrime_aesni, 2)
+SM4_DEFINE_EXPAND_KERNEL(expand_aesni, "avx2,aes", expand16_aesni, expand8_aesni, 8, 2)
+
+SM4_DEFINE_BATCH_AVX2(batch8_gfni_avx2, "avx2,gfni", T_gfni_avx2, 1)
+SM4_DEFINE_BATCH_AVX2(batch16_gfni_avx2, "avx2,gfni", T_gfni_avx2, 2)
+SM4_DEFINE_KERNEL(crypt_gfni_avx2, "avx2,gfni", batch16_gfni_avx2, batch8_gfni_avx2, 8, 2)
+SM4_DEFINE_LANES_BATCH_AVX2(lanes8_gfni_avx2, "avx2,gfni", T_gfni_avx2, 1)
+SM4_DEFINE_LANES_BATCH_AVX2(lanes16_gfni_avx2, "avx2,gfni", T_gfni_avx2, 2)
+SM4_DEFINE_LANES_KERNEL(lanes_gfni_avx2, "avx2,gfni", lanes16_gfni_avx2, lanes8_gfni_avx2, 8, 2)
+SM4_DEFINE_EXPAND_BATCH_AVX2(expand8_gfni_avx2, "avx2,gfni", TPrime_gfni_avx2, 1)
+SM4_DEFINE_EXPAND_BATCH_AVX2(expand16_gfni_avx2, "avx2,gfni", TPrime_gfni_avx2, 2)
+SM4_DEFINE_EXPAND_KERNEL(expand_gfni_avx2, "avx2,gfni", expand16_gfni_avx2, expand8_gfni_avx2, 8, 2)
+
+//-------------AVX-512ÿ 16 --------------------
+
+SM4_TARGET("avx512f,avx512bw")
+static inline __m512i bswap32_avx512(__m512i x) {
+    const __m512i mask = _mm512_set4_epi32(0x0c0d0e0f, 0x08090a0b, 0x04050607, 0x00010203);
+    return _mm512_shuffle_epi8(x, mask);
+}
+
+SM4_TARGET("avx512f,avx512bw")
+static inline void transpose_avx512(__m512i& a, __m512i& b, __m512i& c, __m512i& d) {
+    __m512i t0 = _mm512_unpacklo_epi32(a, b);
+    __m512i t1 = _mm512_unpackhi_epi32(a, b);
+    __m512i t2 = _mm512_unpacklo_epi32(c, d);
+    __m512i t3 = _mm512_unpackhi_epi32(c, d);
+    a = _mm512_unpacklo_epi64(t0, t2);
+    b = _mm512_unpackhi_epi64(t0, t2);
+    c = _mm512_unpacklo_epi64(t1, t3);
+    d = _mm512_unpackhi_epi64(t1, t3);
+}
+
+SM4_TARGET("avx512f,avx512bw")
+static inline void load16_avx512(const uint8_t* in, __m512i x[4]) {
+    for (int j = 0; j < 4; j++) {
+        x[j] = bswap32_avx512(_mm512_loadu_si512((const void*)(in + j * 64)));
+    }
+    transpose_avx512(x[0], x[1], x[2], x[3]);
+}
+
+SM4_TARGET("avx512f,avx512bw")
+static inline void store16_avx512(uint8_t* out, __m512i x[4]) {
+    transpose_avx512(x[3], x[2], x[1], x[0]);
+    for (int j = 0; j < 4; j++) {
+        _mm512_storeu_si512((void*)(out + j * 64), bswap32_avx512(x[3 - j]));
+    }
+}
+
+SM4_TARGET("avx512f")
+static inline __m512i L_avx512(__m512i x) {
+    __m512i t = _mm512_ternarylogic_epi32(x, _mm512_rol_epi32(x, 2), _mm512_rol_epi32(x, 10), 0x96);
+    return _mm512_ternarylogic_epi32(t, _mm512_rol_epi32(x, 18), _mm512_rol_epi32(x, 24), 0x96);
+}
+
+#define SM4_ROUND_AVX512(TFN, table, x, G, k, A, B, C, D)                                  \
+    for (int g = 0; g < (G); g++) {                                                         \
+        __m512i t = _mm512_ternarylogic_epi32(x[g][B], x[g][C],                             \
+            _mm512_xor_si512(x[g][D], k), 0x96);                                            \
+        x[g][A] = _mm512_xor_si512(x[g][A], TFN(t, table));                                 \
+    }
+
+#define SM4_ROUNDS_AVX512(TFN, rk, table, x, G)                                             \
+    for (int i = 0; i < 32; i += 4) {                                                       \
+        __m512i k0 = _mm512_set1_epi32((int)(rk)[i + 0]);                                   \
+        __m512i k1 = _mm512_set1_epi32((int)(rk)[i + 1]);                                   \
+        __m512i k2 = _mm512_set1_epi32((int)(rk)[i + 2]);                                   \
+        __m512i k3 = _mm512_set1_epi32((int)(rk)[i + 3]);                                   \
+        SM4_ROUND_AVX512(TFN, table, x, G, k0, 0, 1, 2, 3)                                  \
+        SM4_ROUND_AVX512(TFN, table, x, G, k1, 1, 2, 3, 0)                                  \
+        SM4_ROUND_AVX512(TFN, table, x, G, k2, 2, 3, 0, 1)                                  \
+        SM4_ROUND_AVX512(TFN, table, x, G, k3, 3, 0, 1, 2)                                  \
+    }
+
+#define SM4_DEFINE_BATCH_AVX512(NAME, TARGET, TFN, G)                                       \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, const uint32_t* table, const uint8_t* in, uint8_t* out) { \
+        __m512i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) load16_avx512(in + g * 256, x[g]);                    \
+        SM4_ROUNDS_AVX512(TFN, rk, table, x, G)                                             \
+        for (int g = 0; g < (G); g++) store16_avx512(out + g * 256, x[g]);                  \
+    }
+
+//  16 ԵԿг load16_avx512 תúͬͨ˳
+//  j  128 λͨΪ jj+4j+8j+12
+SM4_TARGET("avx512f")
+static inline __m512i laneKeys_avx512(const uint32_t* rk) {
+    const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+    return _mm512_permutexvar_epi32(order, _mm512_loadu_si512((const void*)rk));
+}
+
+#define SM4_ROUNDS_LANES_AVX512(TFN, rk, stride, table, x, G)                              \
+    for (int i = 0; i < 32; i += 4) {                                                       \
+        SM4_ROUND_AVX512(TFN, table, x, G, laneKeys_avx512(rk + (i + 0) * (stride) + g * 16), 0, 1, 2, 3) \
+        SM4_ROUND_AVX512(TFN, table, x, G, laneKeys_avx512(rk + (i + 1) * (stride) + g * 16), 1, 2, 3, 0) \
+        SM4_ROUND_AVX512(TFN, table, x, G, laneKeys_avx512(rk + (i + 2) * (stride) + g * 16), 2, 3, 0, 1) \
+        SM4_ROUND_AVX512(TFN, table, x, G, laneKeys_avx512(rk + (i + 3) * (stride) + g * 16), 3, 0, 1, 2) \
+    }
+
+#define SM4_DEFINE_LANES_BATCH_AVX512(NAME, TARGET, TFN, G)                                 \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* rk, size_t stride, const uint32_t* table,              \
+        const uint8_t* in, uint8_t* out) {                                                  \
+        __m512i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) load16_avx512(in + g * 256, x[g]);                    \
+        SM4_ROUNDS_LANES_AVX512(TFN, rk, stride, table, x, G)                               \
+        for (int g = 0; g < (G); g++) store16_avx512(out + g * 256, x[g]);                  \
+    }
+
+SM4_TARGET("avx512f")
+static inline __m512i LPrime_avx512(__m512i x) {
+    return _mm512_ternarylogic_epi32(x, _mm512_rol_epi32(x, 13), _mm512_rol_epi32(x, 23), 0x96);
+}
+
+// Կչһ֣laneKeys_avx512  4x4 תãͬ
+#define SM4_EXPAND_ROUND_AVX512(TFN, table, x, G, ck, i, rk, stride, A, B, C, D)           \
+    for (int g = 0; g < (G); g++) {                                                         \
+        const __m512i inv = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15); \
+        __m512i t = _mm512_ternarylogic_epi32(x[g][B], x[g][C],                             \
+            _mm512_xor_si512(x[g][D], _mm512_set1_epi32((int)(ck)[i])), 0x96);              \
+        x[g][A] = _mm512_xor_si512(x[g][A], TFN(t, table));                                 \
+        _mm512_storeu_si512((void*)((rk) + (i) * (stride) + g * 16),                        \
+            _mm512_permutexvar_epi32(inv, x[g][A]));                                        \
+    }
+
+#define SM4_DEFINE_EXPAND_BATCH_AVX512(NAME, TARGET, TFN, G)                                \
+    SM4_TARGET(TARGET)                                                                      \
+    static void NAME(const uint32_t* fk, const uint32_t* ck, const uint32_t* table,         \
+        const uint8_t* keys, uint32_t* rk, size_t stride) {                                 \
+        __m512i x[G][4];                                                                    \
+        for (int g = 0; g < (G); g++) {                                                     \
+            load16_avx512(keys + g * 256, x[g]);                                            \
+            for (int j = 0; j < 4; j++) {                                                   \
+                x[g][j] = _mm512_xor_si512(x[g][j], _mm512_set1_epi32((int)fk[j]));         \
+            }                                                                               \
+        }                                                                                   \
+        for (int i = 0; i < 32; i += 4) {                                                   \
+            SM4_EXPAND_ROUND_AVX512(TFN, table, x, G, ck, i + 0, rk, stride, 0, 1, 2, 3)    \
+            SM4_EXPAND_ROUND_AVX512(TFN, table, x, G, ck, i + 1, rk, stride, 1, 2, 3, 0)    \
+            SM4_EXPAND_ROUND_AVX512(TFN, table, x, G, ck, i + 2, rk, stride, 2, 3, 0, 1)    \
+            SM4_EXPAND_ROUND_AVX512(TFN, table, x, G, ck, i + 3, rk, stride, 3, 0, 1, 2)    \
+        }                                                                                   \
+    }
+
+SM4_TARGET("avx512f,avx512bw")
+static inline __m512i T_gather_avx512(__m512i x, const uint32_t* table) {
+    const __m512i m = _mm512_set1_epi32(0xff);
+    __m512i y3 = _mm512_i32gather_epi32(_mm512_srli_epi32(x, 24), table, 4);
+    __m512i y2 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_srli_epi32(x, 16), m), table, 4);
+    __m512i y1 = _mm512_i32gather_epi32(_mm512_and_si512(_mm512_srli_epi32(x, 8), m), table, 4);
+    __m512i y0 = _mm512_i32gather_epi32(_mm512_and_si512(x, m), table, 4);
+    __m512i y = _mm512_xor_si512(_mm512_rol_epi32(y3, 8), y2);
+    y = _mm512_xor_si512(_mm512_rol_epi32(y, 8), y1);
+    y = _mm512_xor_si512(_mm512_rol_epi32(y, 8), y0);
+    return y;
+}
+
+//-------------GFNI + AVX-512鹲 64 --------------------
+
+SM4_TARGET("avx512f,avx512bw,gfni")
+static inline __m512i S_gfni_avx512(__m512i x) {
+    x = _mm512_gf2p8affine_epi64_epi8(x, _mm512_set1_epi64((long long)kGfniPre), kGfniPreC);
+    return _mm512_gf2p8affineinv_epi64_epi8(x, _mm512_set1_epi64((long long)kGfniPost), kGfniPostC);
+}
+
+SM4_TARGET("avx512f,avx512bw,gfni")
+static inline __m512i T_gfni_avx512(__m512i x, const uint32_t*) {
+    return L_avx512(S_gfni_avx512(x));
+}
+
+SM4_TARGET("avx512f,avx512bw,gfni")
+static inline __m512i TPrime_gfni_avx512(__m512i x, const uint32_t*) {
+    return LPrime_avx512(S_gfni_avx512(x));
+}
+
+SM4_DEFINE_BATCH_AVX512(batch16_gather_avx512, "avx512f,avx512bw", T_gather_avx512, 1)
+SM4_DEFINE_KERNEL(crypt_gather_avx512, "avx512f,avx512bw", batch16_gather_avx512, batch16_gather_avx512, 16, 1)
+SM4_DEFINE_LANES_BATCH_AVX512(lanes16_gather_avx512, "avx512f,avx512bw", T_gather_avx512, 1)
+SM4_DEFINE_LANES_KERNEL(lanes_gather_avx512, "avx512f,avx512bw", lanes16_gather_avx512, lanes16_gather_avx512, 16, 1)
+SM4_DEFINE_EXPAND_BATCH_AVX512(expand16_gather_avx512, "avx512f,avx512bw", T_gather_avx512, 1)
+SM4_DEFINE_EXPAND_KERNEL(expand_gather_avx512, "avx512f,avx512bw", expand16_gather_avx512, expand16_gather_avx512, 16, 1)
+
+SM4_DEFINE_BATCH_AVX512(batch16_gfni_avx512, "avx512f,avx512bw,gfni", T_gfni_avx512, 1)
+SM4_DEFINE_BATCH_AVX512(batch64_gfni_avx512, "avx512f,avx512bw,gfni", T_gfni_avx512, 4)
+SM4_DEFINE_KERNEL(crypt_gfni_avx512, "avx512f,avx512bw,gfni", batch64_gfni_avx512, batch16_gfni_avx512, 16, 4)
+SM4_DEFINE_LANES_BATCH_AVX512(lanes16_gfni_avx512, "avx512f,avx512bw,gfni", T_gfni_avx512, 1)
+SM4_DEFINE_LANES_BATCH_AVX512(lanes64_gfni_avx512, "avx512f,avx512bw,gfni", T_gfni_avx512, 4)
+SM4_DEFINE_LANES_KERNEL(lanes_gfni_avx512, "avx512f,avx512bw,gfni", lanes64_gfni_avx512, lanes16_gfni_avx512, 16, 4)
+SM4_DEFINE_EXPAND_BATCH_AVX512(expand16_gfni_avx512, "avx512f,avx512bw,gfni", TPrime_gfni_avx512, 1)
+SM4_DEFINE_EXPAND_BATCH_AVX512(expand64_gfni_avx512, "avx512f,avx512bw,gfni", TPrime_gfni_avx512, 4)
+SM4_DEFINE_EXPAND_KERNEL(expand_gfni_avx512, "avx512f,avx512bw,gfni", expand64_gfni_avx512, expand16_gfni_avx512, 16, 4)
+
+//-------------ںѡ--------------------
+
+static const Kernel kKernels[KERNEL_COUNT] = {
+    { "avx2", 8, 8, crypt_gather_avx2, lanes_gather_avx2, expand_gather_avx2 },
+    { "avx512", 16, 16, crypt_gather_avx512, lanes_gather_avx512, expand_gather_avx512 },
+    { "aesni", 8, 16, crypt_aesni, lanes_aesni, expand_aesni },
+    { "gfni-avx2", 8, 16, crypt_gfni_avx2, lanes_gfni_avx2, expand_gfni_avx2 },
+    { "gfni-avx512", 16, 64, crypt_gfni_avx512, lanes_gfni_avx512, expand_gfni_avx512 },
+};
+
+static bool supported(KernelId id) {
+    const CpuFeatures& f = cpuFeatures();
+    switch (id) {
+    case KERNEL_AVX2:        return f.avx2;
+    case KERNEL_AVX512:      return f.avx512;
+    case KERNEL_AESNI:       return f.avx2 && f.aesni;
+    case KERNEL_GFNI_AVX2:   return f.avx2 && f.gfni;
+    case KERNEL_GFNI_AVX512: return f.avx512 && f.gfni;
+    default:                 return false;
+    }
+}
+
+const Kernel* kernel(KernelId id) {
+    return supported(id) ? &kKernels[id] : nullptr;
+}
+
+// ʵ´Ӹߵ
+static const Kernel* select() {
+    static const KernelId order[] = {
+        KERNEL_GFNI_AVX512, KERNEL_GFNI_AVX2, KERNEL_AESNI, KERNEL_AVX512, KERNEL_AVX2
+    };
+    for (KernelId id : order) {
+        if (supported(id)) return &kKernels[id];
+    }
+    return nullptr;
+}
+
+const Kernel* bestKernel() {
+    static const Kernel* best = select();
+    return best;
+}
+
+}
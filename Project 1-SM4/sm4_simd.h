@@ -0,0 +1,78 @@
+#ifndef SM4_SIMD_H
+#define SM4_SIMD_H
+#include <cstdint>
+#include <cstddef>
+
+// ָչʱ cpuid ѡãMSVC Ҫ
+#if defined(_MSC_VER)
+#define SM4_TARGET(t)
+#else
+#define SM4_TARGET(t) __attribute__((target(t)))
+#endif
+
+// SM4 鲢ںˣڲʹã
+//
+// ں˰ width  4  32 λתõĴУ
+// 32 ֵȫڼĴɣתûطʽ
+namespace sm4simd {
+
+    // CPU ԣʱͨ cpuid/xgetbv һΣ
+    struct CpuFeatures {
+        bool avx2;
+        bool avx512;    // AVX-512 F + BWҲϵͳ zmm ״̬
+        bool aesni;
+        bool gfni;
+        bool pclmul;    // PCLMULQDQGHASH
+        bool vpclmul;   // VPCLMULQDQ512 λʱҪ avx512
+    };
+
+    const CpuFeatures& cpuFeatures();
+
+    // rk: 32 ԿʱԿ
+    // table: 256  T table[i] = L(Sbox[i]) SM4::T3
+    // blocks: һβںڲ봦
+    typedef void (*CryptFn)(const uint32_t* rk, const uint32_t* table,
+        const uint8_t* in, uint8_t* out, size_t blocks);
+
+    // ÿʹøԵԿ໺ͬ֯ͨУ
+    // rk: rk[r * stride + i] Ϊ i  r ֵԿstride >= blocks
+    // blocks:  width ı
+    typedef void (*LanesFn)(const uint32_t* rk, size_t stride, const uint32_t* table,
+        const uint8_t* in, uint8_t* out, size_t blocks);
+
+    // ԿչÿͨչһԿںʹͬ S ʵ
+    // fk/ck: ϵͳ FK ̶ CK
+    // table: 256  T' table[i] = L'(Sbox[i]) SM4::T3_primeֻвںʹã
+    // keys: count  16 ֽԿrk: rk[r * stride + i] Ϊ i Կ r ֵԿ
+    //  cryptLanes ԿУstride >= count
+    // count:  width ı
+    typedef void (*ExpandFn)(const uint32_t* fk, const uint32_t* ck, const uint32_t* table,
+        const uint8_t* keys, uint32_t* rk, size_t stride, size_t count);
+
+    struct Kernel {
+        const char* name;   // 
+        size_t width;       // һ鲢дķͨ
+        size_t lanes;       // ֯һķ໺Ȱͨ
+        CryptFn crypt;
+        LanesFn cryptLanes;
+        ExpandFn expandKeys;
+    };
+
+    enum KernelId {
+        KERNEL_AVX2,        // AVX2 vpgatherdd
+        KERNEL_AVX512,      // AVX-512 
+        KERNEL_AESNI,       // AES-NI  S УAVX2 Ա任
+        KERNEL_GFNI_AVX2,   // GF2P8AFFINE  S У256 λ
+        KERNEL_GFNI_AVX512, // GF2P8AFFINE  S У512 λ
+        KERNEL_COUNT
+    };
+
+    // ָںˣCPU ֧ʱ nullptr
+    const Kernel* kernel(KernelId id);
+
+    // ǰ CPU ĶںˣCPU ֧κչʱ nullptr
+    const Kernel* bestKernel();
+
+}
+
+#endif // SM4_SIMD_H
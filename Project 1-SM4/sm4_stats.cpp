@@ -0,0 +1,193 @@
+#include "sm4_stats.h"
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace sm4stats {
+
+    std::atomic<bool> cyclesEnabled(false);
+
+    static const char* const kModeNames[kModes] = { "ecb", "cbc", "ctr", "gcm", "xts" };
+    static const char* const kDirectionNames[kDirections] = { "encrypt", "decrypt" };
+    static const char* const kCallNames[kCalls] = { "encrypt", "decrypt", "gcm_encrypt", "gcm_decrypt" };
+    static const char* const kBackendNames[kBackends] = {
+        "reference", "ttable", "avx2", "avx512", "aesni", "gfni-avx2", "gfni-avx512"
+    };
+
+    // ̵߳ļ˳߳µۼֵԼ reset ʱĻ׼
+    struct Registry {
+        std::mutex mutex;
+        std::vector<ThreadCounters*> threads;
+        SM4StatsSnapshot retired;
+        SM4StatsSnapshot baseline;
+
+        Registry() {
+            memset(&retired, 0, sizeof(retired));
+            memset(&baseline, 0, sizeof(baseline));
+        }
+    };
+
+    // ˳ʱ߳̿Уע
+    static Registry& registry() {
+        static Registry* r = new Registry;
+        return *r;
+    }
+
+    // һ̵߳ļۼӵ
+    static void accumulate(SM4StatsSnapshot& s, const ThreadCounters& c) {
+        auto get = [](const std::atomic<uint64_t>& v) { return v.load(std::memory_order_relaxed); };
+        for (int m = 0; m < kModes; m++) {
+            for (int d = 0; d < kDirections; d++) {
+                s.bytes[m][d] += get(c.bytes[m][d]);
+                s.blocks[m][d] += get(c.blocks[m][d]);
+            }
+        }
+        for (int b = 0; b < kBackends; b++) s.backends[b] += get(c.backends[b]);
+        s.keyExpansions += get(c.keyExpansions);
+        s.tagFailures += get(c.tagFailures);
+        s.paddingFailures += get(c.paddingFailures);
+        for (int k = 0; k < kCalls; k++) {
+            for (int i = 0; i < kCycleBuckets; i++) s.cycleBuckets[k][i] += get(c.cycleBuckets[k][i]);
+            s.cycleCount[k] += get(c.cycleCount[k]);
+            s.cycleSum[k] += get(c.cycleSum[k]);
+        }
+    }
+
+    // ߳˳ʱѼ retired ע
+    struct ThreadSlot {
+        ThreadCounters* counters = nullptr;
+
+        ~ThreadSlot() {
+            if (!counters) return;
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            accumulate(r.retired, *counters);
+            for (size_t i = 0; i < r.threads.size(); i++) {
+                if (r.threads[i] == counters) {
+                    r.threads[i] = r.threads.back();
+                    r.threads.pop_back();
+                    break;
+                }
+            }
+            delete counters;
+        }
+    };
+
+    static thread_local ThreadSlot slot;
+
+    ThreadCounters& local() {
+        if (!slot.counters) {
+            ThreadCounters* c = new ThreadCounters();
+            Registry& r = registry();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.push_back(c);
+            slot.counters = c;
+        }
+        return *slot.counters;
+    }
+
+    void add_backend(const char* name) {
+        for (int b = 0; b < kBackends; b++) {
+            if (strcmp(name, kBackendNames[b]) == 0) {
+                bump(local().backends[b], 1);
+                return;
+            }
+        }
+    }
+
+    // a -= b
+    static void subtract(SM4StatsSnapshot& a, const SM4StatsSnapshot& b) {
+        uint64_t* x = reinterpret_cast<uint64_t*>(&a);
+        const uint64_t* y = reinterpret_cast<const uint64_t*>(&b);
+        for (size_t i = 0; i < sizeof(SM4StatsSnapshot) / sizeof(uint64_t); i++) x[i] -= y[i];
+    }
+
+    static void total(SM4StatsSnapshot& s) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        s = r.retired;
+        for (ThreadCounters* c : r.threads) accumulate(s, *c);
+    }
+}
+
+bool sm4_stats_compiled() {
+#ifdef SM4_STATS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void sm4_stats_enable_cycles(bool enable) {
+    sm4stats::cyclesEnabled.store(enable, std::memory_order_relaxed);
+}
+
+void sm4_stats_snapshot(SM4StatsSnapshot& snapshot) {
+    sm4stats::total(snapshot);
+    sm4stats::Registry& r = sm4stats::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    sm4stats::subtract(snapshot, r.baseline);
+}
+
+void sm4_stats_reset() {
+    SM4StatsSnapshot now;
+    sm4stats::total(now);
+    sm4stats::Registry& r = sm4stats::registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.baseline = now;
+}
+
+std::string sm4_stats_prometheus() {
+    using namespace sm4stats;
+    SM4StatsSnapshot s;
+    sm4_stats_snapshot(s);
+    std::ostringstream out;
+
+    out << "# HELP sm4_bytes_total Bytes processed by mode and direction.\n"
+        << "# TYPE sm4_bytes_total counter\n";
+    for (int m = 0; m < kModes; m++) {
+        for (int d = 0; d < kDirections; d++) {
+            out << "sm4_bytes_total{mode=\"" << kModeNames[m] << "\",direction=\"" << kDirectionNames[d]
+                << "\"} " << s.bytes[m][d] << "\n";
+        }
+    }
+    out << "# HELP sm4_blocks_total 16-byte blocks processed by mode and direction.\n"
+        << "# TYPE sm4_blocks_total counter\n";
+    for (int m = 0; m < kModes; m++) {
+        for (int d = 0; d < kDirections; d++) {
+            out << "sm4_blocks_total{mode=\"" << kModeNames[m] << "\",direction=\"" << kDirectionNames[d]
+                << "\"} " << s.blocks[m][d] << "\n";
+        }
+    }
+    out << "# HELP sm4_backend_selected_total Backend chosen when an SM4 or SM4Key object is constructed.\n"
+        << "# TYPE sm4_backend_selected_total counter\n";
+    for (int b = 0; b < kBackends; b++) {
+        out << "sm4_backend_selected_total{backend=\"" << kBackendNames[b] << "\"} " << s.backends[b] << "\n";
+    }
+    out << "# HELP sm4_key_expansions_total Keys expanded into round keys.\n"
+        << "# TYPE sm4_key_expansions_total counter\n"
+        << "sm4_key_expansions_total " << s.keyExpansions << "\n"
+        << "# HELP sm4_gcm_tag_failures_total GCM authentication failures.\n"
+        << "# TYPE sm4_gcm_tag_failures_total counter\n"
+        << "sm4_gcm_tag_failures_total " << s.tagFailures << "\n"
+        << "# HELP sm4_padding_failures_total PKCS#7 padding check failures.\n"
+        << "# TYPE sm4_padding_failures_total counter\n"
+        << "sm4_padding_failures_total " << s.paddingFailures << "\n";
+
+    out << "# HELP sm4_call_cycles TSC cycles per call (recorded while enabled).\n"
+        << "# TYPE sm4_call_cycles histogram\n";
+    for (int k = 0; k < kCalls; k++) {
+        uint64_t cumulative = 0;
+        for (int i = 0; i < kCycleBuckets; i++) {
+            cumulative += s.cycleBuckets[k][i];
+            out << "sm4_call_cycles_bucket{call=\"" << kCallNames[k] << "\",le=\"";
+            if (i + 1 < kCycleBuckets) out << (uint64_t(1) << i);
+            else out << "+Inf";
+            out << "\"} " << cumulative << "\n";
+        }
+        out << "sm4_call_cycles_sum{call=\"" << kCallNames[k] << "\"} " << s.cycleSum[k] << "\n"
+            << "sm4_call_cycles_count{call=\"" << kCallNames[k] << "\"} " << s.cycleCount[k] << "\n";
+    }
+    return out.str();
+}
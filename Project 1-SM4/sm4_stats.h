@@ -0,0 +1,148 @@
+#ifndef SM4_STATS_H
+#define SM4_STATS_H
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// SM4 ͳƣѡ
+//
+// ʱ SM4_STATS ڿвͳƵ㣬 SM4_STAT_* ȫչΪգûκο
+// úÿ߳дԼļ޹Уȡʱٻ̣߳
+// úʱRDTSC ֱͼҪʱ sm4_stats_enable_cycles(true) 򿪡
+//
+// ֽڸӿڵڴ룬ӿ֮以ʱֻһΣCTR ӽͬͳһڼܷ
+// SM4Engine зֵĴ GCM ҵ sm4_file_read ܣ GCM ䷽롣
+
+namespace sm4stats {
+
+    // ģʽ
+    enum Mode { MODE_ECB, MODE_CBC, MODE_CTR, MODE_GCM, MODE_XTS, kModes };
+
+    // 
+    enum Direction { ENCRYPT, DECRYPT, kDirections };
+
+    // ͳƺʱĵ
+    enum Call { CALL_ENCRYPT, CALL_DECRYPT, CALL_GCM_ENCRYPT, CALL_GCM_DECRYPT, kCalls };
+
+    // ˣ SM4::backendName() ƶӦ
+    enum Backend { BACKEND_REFERENCE, BACKEND_TTABLE, BACKEND_AVX2, BACKEND_AVX512,
+                   BACKEND_AESNI, BACKEND_GFNI_AVX2, BACKEND_GFNI_AVX512, kBackends };
+
+    // ʱֱͼͰ i ͰͳС 2^iҲС 2^(i-1)ĵ
+    const int kCycleBuckets = 40;
+
+    // ÿ̵߳ļֻ߳д룬relaxed дɣҪԭӼ
+    //  64 ֽڶ루C++17  new أ̵߳ļѶ
+    struct alignas(64) ThreadCounters {
+        std::atomic<uint64_t> bytes[kModes][kDirections];
+        std::atomic<uint64_t> blocks[kModes][kDirections];
+        std::atomic<uint64_t> backends[kBackends];
+        std::atomic<uint64_t> keyExpansions;
+        std::atomic<uint64_t> tagFailures;
+        std::atomic<uint64_t> paddingFailures;
+        std::atomic<uint64_t> cycleBuckets[kCalls][kCycleBuckets];
+        std::atomic<uint64_t> cycleCount[kCalls];
+        std::atomic<uint64_t> cycleSum[kCalls];
+    };
+
+    // ǰ̵߳ļ״ʹʱע
+    ThreadCounters& local();
+
+    // Ƿ¼úʱ
+    extern std::atomic<bool> cyclesEnabled;
+
+    inline void bump(std::atomic<uint64_t>& counter, uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    inline void add_bytes(Mode mode, Direction direction, uint64_t bytes) {
+        ThreadCounters& c = local();
+        bump(c.bytes[mode][direction], bytes);
+        bump(c.blocks[mode][direction], (bytes + 15) / 16);
+    }
+
+    void add_backend(const char* name);
+
+    inline void add_key_expansions(uint64_t n) { bump(local().keyExpansions, n); }
+    inline void add_tag_failure() { bump(local().tagFailures, 1); }
+    inline void add_padding_failure() { bump(local().paddingFailures, 1); }
+
+    // ڵĵúʱʱ TSCʱֱͼδʱֻһζȡ־
+    class CycleScope {
+    public:
+        explicit CycleScope(Call call)
+            : call(call), start(cyclesEnabled.load(std::memory_order_relaxed) ? __rdtsc() : 0) {}
+
+        ~CycleScope() {
+            if (start == 0) return;
+            uint64_t cycles = __rdtsc() - start;
+            int bucket = 0;
+            while (bucket < kCycleBuckets - 1 && (cycles >> bucket) != 0) bucket++;
+            ThreadCounters& c = local();
+            bump(c.cycleBuckets[call][bucket], 1);
+            bump(c.cycleCount[call], 1);
+            bump(c.cycleSum[call], cycles);
+        }
+
+        CycleScope(const CycleScope&) = delete;
+        CycleScope& operator=(const CycleScope&) = delete;
+
+    private:
+        Call call;
+        uint64_t start;
+    };
+}
+
+// SM4_STAT_BYTES  mode ʱıʽ簴 SM4::Mode 㣩öؼռ
+#ifdef SM4_STATS
+#define SM4_STAT_BYTES(mode, direction, bytes) \
+    do { using namespace sm4stats; add_bytes(mode, direction, bytes); } while (0)
+#define SM4_STAT_BACKEND(name) sm4stats::add_backend(name)
+#define SM4_STAT_KEY_EXPANSIONS(n) sm4stats::add_key_expansions(n)
+#define SM4_STAT_TAG_FAILURE() sm4stats::add_tag_failure()
+#define SM4_STAT_PADDING_FAILURE() sm4stats::add_padding_failure()
+#define SM4_STAT_CYCLES(call) sm4stats::CycleScope sm4StatCycles(sm4stats::call)
+#else
+#define SM4_STAT_BYTES(mode, direction, bytes) ((void)0)
+#define SM4_STAT_BACKEND(name) ((void)0)
+#define SM4_STAT_KEY_EXPANSIONS(n) ((void)0)
+#define SM4_STAT_TAG_FAILURE() ((void)0)
+#define SM4_STAT_PADDING_FAILURE() ((void)0)
+#define SM4_STAT_CYCLES(call) ((void)0)
+#endif
+
+// ̻߳ܺͳƿգϴ sm4_stats_reset 
+struct SM4StatsSnapshot {
+    uint64_t bytes[sm4stats::kModes][sm4stats::kDirections];
+    uint64_t blocks[sm4stats::kModes][sm4stats::kDirections];
+    uint64_t backends[sm4stats::kBackends];     // ˱ѡУ SM4/SM4KeyĴ
+    uint64_t keyExpansions;                     // չԿ
+    uint64_t tagFailures;                       // GCM ǩ֤ʧܴ
+    uint64_t paddingFailures;                   // PKCS#7 Уʧܴ
+    uint64_t cycleBuckets[sm4stats::kCalls][sm4stats::kCycleBuckets];
+    uint64_t cycleCount[sm4stats::kCalls];
+    uint64_t cycleSum[sm4stats::kCalls];
+};
+
+// ǷڱʱͳƣSM4_STATS
+bool sm4_stats_compiled();
+
+// 򿪻رյúʱֱͼ
+void sm4_stats_enable_cycles(bool enable);
+
+// ̣߳˳̣߳ļ
+void sm4_stats_snapshot(SM4StatsSnapshot& snapshot);
+
+// ԵǰֵΪ׼㣺֮Ŀֻ˺̵߳ļ޸ģд뷽
+void sm4_stats_reset();
+
+// Prometheus ıʽtext/plain; version=0.0.4
+std::string sm4_stats_prometheus();
+
+#endif // SM4_STATS_H
@@ -0,0 +1,981 @@
+// SM4 已知答案测试与多后端差分测试
+//
+//   sm4test [--seed N] [--rounds N] [--quick]
+//
+// 已知答案：GB/T 32907-2016 附录 A 的两组示例（含 1,000,000 次迭代加密），
+// draft-ribose-cfrg-sm4 的 ECB/CBC 示例，RFC 8998 的 SM4-GCM 示例，SM4 CTR_DRBG 的输出；
+// 每个向量在所有可用后端、单组/多组/流式等不同接口上各跑一遍。
+// 差分测试：以 REFERENCE 后端（逐块 F()/T()）为基准，随机数据下比较其余每个后端
+// 在各种长度、缓冲区对齐、原地处理以及线程数下的结果（含多密钥内核、多缓冲区 CBC、批量 GCM、
+// 按扇区的 XTS 与流式 GCM），并逐一比较 GHASH 的各种实现。
+// SM4Engine：混合操作、切分的大作业、计数器回绕、篡改标签与回调，结果与一次性接口比较。
+// 分块加密文件：各种长度与块大小的往返、跨块与分组中间开始的区间读取，以及篡改文件头、
+// 交换块、截断、修改标签后的拒绝。
+// 所有检查通过时返回 0；--quick 跳过 1,000,000 次迭代并减少随机轮数。
+#include "sm4.h"
+#include "ghash.h"
+#include "sm4_drbg.h"
+#include "sm4_engine.h"
+#include "sm4_file.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <memory>
+#include <future>
+#include <functional>
+#include <array>
+#include <thread>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+using namespace std;
+
+static int failures = 0;
+static int checks = 0;
+
+static void check(bool ok, const string& name) {
+    checks++;
+    if (!ok) {
+        failures++;
+        cout << "  失败: " << name << endl;
+    }
+}
+
+static vector<uint8_t> from_hex(const string& hex) {
+    vector<uint8_t> bytes(hex.size() / 2);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(stoul(hex.substr(2 * i, 2), nullptr, 16));
+    }
+    return bytes;
+}
+
+static bool equal(const uint8_t* a, const vector<uint8_t>& b) {
+    return memcmp(a, b.data(), b.size()) == 0;
+}
+
+struct BackendInfo {
+    SM4::Backend backend;
+    const char* name;
+};
+
+static const BackendInfo kBackends[] = {
+    { SM4::REFERENCE, "reference" },
+    { SM4::TTABLE, "ttable" },
+    { SM4::AVX2, "avx2" },
+    { SM4::AVX512, "avx512" },
+    { SM4::AESNI, "aesni" },
+    { SM4::GFNI, "gfni" },
+};
+
+// 当前 CPU 支持的后端
+static vector<BackendInfo> available_backends() {
+    vector<BackendInfo> list;
+    const uint8_t key[16] = { 0 };
+    for (const BackendInfo& b : kBackends) {
+        try {
+            SM4Key probe(key, b.backend);
+            list.push_back(b);
+        }
+        catch (const runtime_error&) {
+            cout << "跳过后端 " << b.name << "（当前 CPU 不支持）" << endl;
+        }
+    }
+    return list;
+}
+
+//-------------已知答案测试--------------
+
+static const char* kKey = "0123456789abcdeffedcba9876543210";
+
+// GB/T 32907-2016 附录 A：示例 1 加密一次，示例 2 用同一密钥反复加密 1,000,000 次
+static void test_gbt32907(const vector<BackendInfo>& backends, bool quick) {
+    cout << "GB/T 32907-2016 示例" << endl;
+    vector<uint8_t> key = from_hex(kKey);
+    vector<uint8_t> plain = from_hex(kKey);
+    vector<uint8_t> once = from_hex("681edf34d206965e86b3e94f536e4246");
+    vector<uint8_t> million = from_hex("595298c7c6fd271f0402f804c33d3f66");
+
+    for (const BackendInfo& b : backends) {
+        string name = b.name;
+        SM4 sm4(key.data(), SM4::ECB, b.backend);
+        SM4Key shared(key.data(), b.backend);
+        uint8_t out[16], back[16];
+
+        sm4.encryptBlock(plain.data(), out);
+        check(equal(out, once), name + " SM4::encryptBlock");
+        sm4.decryptBlock(out, back);
+        check(equal(back, plain), name + " SM4::decryptBlock");
+        shared.encryptBlock(plain.data(), out);
+        check(equal(out, once), name + " SM4Key::encryptBlock");
+        shared.encryptBlocks(plain.data(), out, 1);
+        check(equal(out, once), name + " SM4Key::encryptBlocks");
+        shared.decryptBlocks(out, back, 1);
+        check(equal(back, plain), name + " SM4Key::decryptBlocks");
+
+        if (quick) continue;
+        // 单组接口和多分组内核各迭代一次，再原路解密回明文
+        uint8_t x[16], y[16];
+        memcpy(x, plain.data(), 16);
+        memcpy(y, plain.data(), 16);
+        for (int i = 0; i < 1000000; i++) {
+            shared.encryptBlock(x, x);
+            shared.encryptBlocks(y, y, 1);
+        }
+        check(equal(x, million), name + " 1,000,000 次 encryptBlock");
+        check(equal(y, million), name + " 1,000,000 次 encryptBlocks");
+        for (int i = 0; i < 1000000; i++) {
+            shared.decryptBlocks(y, y, 1);
+        }
+        check(equal(y, plain), name + " 1,000,000 次 decryptBlocks");
+    }
+}
+
+// draft-ribose-cfrg-sm4 的 ECB/CBC 示例；CTR 的结果与 OpenSSL 一致
+static void test_modes(const vector<BackendInfo>& backends) {
+    cout << "ECB/CBC/CTR 示例" << endl;
+    vector<uint8_t> key = from_hex(kKey);
+    vector<uint8_t> iv = from_hex("000102030405060708090a0b0c0d0e0f");
+    vector<uint8_t> plain = from_hex("aaaaaaaabbbbbbbbccccccccddddddddeeeeeeeeffffffffaaaaaaaabbbbbbbb");
+    vector<uint8_t> ecb = from_hex("5ec8143de509cff7b5179f8f474b86192f1d305a7fb17df985f81c8482192304");
+    vector<uint8_t> cbc = from_hex("78ebb11cc40b0a48312aaeb2040244cb4cb7016951909226979b0d15dc6a8f6d");
+    vector<uint8_t> ctr = from_hex("ac3236cb861dd316e6413b4e3c7524b781e9e3a5bf5c03fe703bb94f3abb16a1");
+
+    for (const BackendInfo& b : backends) {
+        string name = b.name;
+        SM4Key shared(key.data(), b.backend);
+        uint8_t out[32], back[32];
+
+        SM4 sm4ecb(key.data(), SM4::ECB, b.backend);
+        sm4ecb.encrypt_simd(plain.data(), 32, out);
+        check(equal(out, ecb), name + " ECB encrypt_simd");
+        sm4ecb.encrypt(plain.data(), 32, out);
+        check(equal(out, ecb), name + " ECB encrypt");
+
+        SM4 sm4cbc(key.data(), SM4::CBC, b.backend);
+        sm4cbc.setIV(iv.data());
+        sm4cbc.encrypt(plain.data(), 32, out);
+        check(equal(out, cbc), name + " CBC encrypt");
+        SM4Context cbcCtx(shared, SM4::CBC, iv.data());
+        cbcCtx.encryptBlocks(plain.data(), 32, out);
+        check(equal(out, cbc), name + " SM4Context CBC");
+        cbcCtx.setIV(iv.data());
+        cbcCtx.init(false);
+        cbcCtx.setPadding(false);
+        size_t n = cbcCtx.update(cbc.data(), 32, back);
+        n += cbcCtx.final(back + n);
+        check(n == 32 && equal(back, plain), name + " SM4Context CBC 无填充解密");
+        sm4_cbc_decrypt(shared, iv.data(), cbc.data(), 32, back, 1);
+        check(equal(back, plain), name + " sm4_cbc_decrypt");
+
+        sm4_ctr_crypt(shared, iv.data(), plain.data(), 32, out, 1);
+        check(equal(out, ctr), name + " sm4_ctr_crypt");
+        SM4 sm4ctr(key.data(), SM4::CTR, b.backend);
+        sm4ctr.setIV(iv.data());
+        sm4ctr.encrypt(plain.data(), 32, out);
+        check(equal(out, ctr), name + " SM4 CTR");
+    }
+}
+
+// RFC 8998 附录 A.1 的 SM4-GCM 示例
+static void test_gcm_rfc8998(const vector<BackendInfo>& backends) {
+    cout << "RFC 8998 SM4-GCM 示例" << endl;
+    vector<uint8_t> key = from_hex(kKey);
+    vector<uint8_t> iv = from_hex("00001234567800000000abcd");
+    vector<uint8_t> aad = from_hex("feedfacedeadbeeffeedfacedeadbeefabaddad2");
+    vector<uint8_t> plain = from_hex(
+        "aaaaaaaaaaaaaaaabbbbbbbbbbbbbbbbccccccccccccccccdddddddddddddddd"
+        "eeeeeeeeeeeeeeeeffffffffffffffffeeeeeeeeeeeeeeeeaaaaaaaaaaaaaaaa");
+    vector<uint8_t> cipher = from_hex(
+        "17f399f08c67d5ee19d0dc9969c4bb7d5fd46fd3756489069157b282bb200735"
+        "d82710ca5c22f0ccfa7cbf93d496ac15a56834cbcf98c397b4024a2691233b8d");
+    vector<uint8_t> tag = from_hex("83de3541e4c2b58177e065a9bf7b62ec");
+    size_t n = plain.size();
+
+    for (const BackendInfo& b : backends) {
+        string name = b.name;
+        SM4Key shared(key.data(), b.backend);
+        vector<uint8_t> out(n), back(n);
+        uint8_t t[16];
+
+        sm4_gcm_encrypt(shared, plain.data(), n, aad.data(), aad.size(), iv.data(), 12, out.data(), t, 16, 1);
+        check(equal(out.data(), cipher) && equal(t, tag), name + " sm4_gcm_encrypt");
+        check(sm4_gcm_decrypt(shared, cipher.data(), n, aad.data(), aad.size(), iv.data(), 12, tag.data(), 16, back.data(), 1)
+            && back == plain, name + " sm4_gcm_decrypt");
+
+        SM4 sm4(key.data(), SM4::ECB, b.backend);
+        sm4.sm4_gcm_encrypt(sm4, plain.data(), int(n), aad.data(), int(aad.size()), iv.data(), 12, out.data(), t, 16);
+        check(equal(out.data(), cipher) && equal(t, tag), name + " SM4::sm4_gcm_encrypt");
+
+        // 流式接口按不规则的片段长度输入
+        SM4GcmContext ctx(shared);
+        ctx.init(iv.data(), 12, true);
+        ctx.setAAD(aad.data(), 7);
+        ctx.setAAD(aad.data() + 7, aad.size() - 7);
+        ctx.update(plain.data(), 5, out.data());
+        ctx.update(plain.data() + 5, 40, out.data() + 5);
+        ctx.update(plain.data() + 45, n - 45, out.data() + 45);
+        ctx.finish(t);
+        check(equal(out.data(), cipher) && equal(t, tag), name + " SM4GcmContext");
+
+        vector<uint8_t> bad = tag;
+        bad[15] ^= 1;
+        check(!sm4_gcm_decrypt(shared, cipher.data(), n, aad.data(), aad.size(), iv.data(), 12, bad.data(), 16, back.data(), 1),
+            name + " 篡改标签后应认证失败");
+    }
+
+    // 流式接口的生命周期：init 之前、finish/verify 之后都不能继续使用，标签不能短于 12 字节
+    auto throws = [](const function<void()>& fn) {
+        try {
+            fn();
+        }
+        catch (const exception&) {
+            return true;
+        }
+        return false;
+    };
+    SM4Key shared(key.data());
+    SM4GcmContext ctx(shared);
+    vector<uint8_t> out(n);
+    uint8_t t[16];
+    check(throws([&] { ctx.update(plain.data(), n, out.data()); }), "SM4GcmContext 未 init 时 update 应失败");
+    check(throws([&] { ctx.setAAD(aad.data(), aad.size()); }), "SM4GcmContext 未 init 时 setAAD 应失败");
+    check(throws([&] { ctx.finish(t); }), "SM4GcmContext 未 init 时 finish 应失败");
+
+    ctx.init(iv.data(), 12, true);
+    ctx.setAAD(aad.data(), aad.size());
+    ctx.update(plain.data(), n, out.data());
+    check(throws([&] { ctx.finish(t, SM4GcmContext::MIN_TAG_LENGTH - 1); }), "SM4GcmContext 过短的标签应被拒绝");
+    ctx.finish(t, 12);
+    check(equal(out.data(), cipher) && memcmp(t, tag.data(), 12) == 0, "SM4GcmContext 12 字节标签");
+    check(throws([&] { ctx.update(plain.data(), n, out.data()); }), "SM4GcmContext finish 之后 update 应失败");
+    check(throws([&] { ctx.setAAD(aad.data(), aad.size()); }), "SM4GcmContext finish 之后 setAAD 应失败");
+    check(throws([&] { ctx.finish(t); }), "SM4GcmContext finish 之后再次 finish 应失败");
+
+    ctx.init(iv.data(), 12, false);
+    ctx.setAAD(aad.data(), aad.size());
+    ctx.update(cipher.data(), n, out.data());
+    check(throws([&] { ctx.verify(tag.data(), 8); }), "SM4GcmContext 过短的标签不能用于验证");
+    check(ctx.verify(tag.data()) && equal(out.data(), plain), "SM4GcmContext 解密");
+    check(throws([&] { ctx.verify(tag.data()); }), "SM4GcmContext verify 之后再次 verify 应失败");
+}
+
+// SM4 CTR_DRBG：固定熵输入下的输出（由按 SP 800-90A 10.2.1 独立编写的 Python 实现生成），
+// 以及线程本地缓冲区跨越交换边界时（单线程与多线程）的输出
+static void test_drbg() {
+    cout << "SM4 CTR_DRBG" << endl;
+    uint8_t entropy[32], entropy2[32], personalization[20], additional[32];
+    for (int i = 0; i < 32; i++) {
+        entropy[i] = static_cast<uint8_t>(i);
+        entropy2[i] = static_cast<uint8_t>(0x80 + i);
+        additional[i] = static_cast<uint8_t>(0xa0 + i);
+    }
+    for (int i = 0; i < 20; i++) personalization[i] = static_cast<uint8_t>(0x40 + i);
+
+    SM4Drbg drbg(entropy, personalization, 20);
+    vector<uint8_t> out(100000);
+    drbg.generate(out.data(), 37);
+    check(equal(out.data(), from_hex("ae16f3e3550534ccfa933934fef38ed2953412963cc0cf05cd884b30f966a52f5554203e47")),
+        "generate 37 字节");
+    drbg.generate(out.data(), 64, additional, 32);
+    check(equal(out.data(), from_hex(
+        "7e8f524201bf0c16091ab9041341c05558282f8ec7c103c07a51c6a31ba09869"
+        "00f035f23a8b5f4331dc8a54243d1ce8211175e0f4b94966d93470ae5bbf8134")), "带附加输入的 generate");
+    drbg.reseed(entropy2, additional, 7);
+    drbg.generate(out.data(), out.size());
+    check(equal(out.data() + out.size() - 32, from_hex("183c6993d1718d484731f1b1783d7b444f85364b875f4293dfbe31536862a95f"))
+        && drbg.reseedCounter() == 3, "reseed 后跨多次请求的 generate");
+
+    // 逐个取 nonce 跨过多次缓冲区交换，不应出现全零或重复的相邻值
+    uint8_t previous[12] = { 0 }, nonce[12];
+    const uint8_t zero[12] = { 0 };
+    bool ok = true;
+    for (int i = 0; i < 20000; i++) {
+        sm4_random_nonce(nonce);
+        ok = ok && memcmp(nonce, zero, 12) != 0 && memcmp(nonce, previous, 12) != 0;
+        memcpy(previous, nonce, 12);
+    }
+    check(ok, "sm4_random_nonce");
+
+    // 多个线程同时取数：每个线程跨过几十次缓冲区交换，后台填充与交换交错时也不应取到全零的分组
+    const int kThreads = 4;
+    vector<char> results(kThreads, 1);
+    vector<thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&results, t] {
+            uint8_t data[48];
+            const uint8_t zeroBlock[16] = { 0 };
+            for (int i = 0; i < 50000; i++) {
+                sm4_random_bytes(data, sizeof(data));
+                for (size_t b = 0; b < sizeof(data); b += 16) {
+                    if (memcmp(data + b, zeroBlock, 16) == 0) results[t] = 0;
+                }
+            }
+        });
+    }
+    for (thread& t : threads) t.join();
+    for (int t = 0; t < kThreads; t++) {
+        check(results[t] != 0, "多线程 sm4_random_bytes 线程 " + to_string(t));
+    }
+}
+
+//-------------差分测试--------------
+
+// 在带偏移的缓冲区上比较：offset 使输入输出从任意字节对齐处开始
+struct Buffers {
+    vector<uint8_t> storage[3];
+    uint8_t* in;
+    uint8_t* expect;
+    uint8_t* actual;
+
+    Buffers(size_t length, size_t offset, mt19937_64& rng) {
+        for (auto& s : storage) s.assign(length + 64, 0);
+        in = storage[0].data() + offset;
+        expect = storage[1].data() + (offset * 7) % 16;
+        actual = storage[2].data() + (offset * 11) % 16;
+        for (size_t i = 0; i < length; i++) in[i] = static_cast<uint8_t>(rng());
+    }
+};
+
+static void random_bytes(mt19937_64& rng, uint8_t* data, size_t length) {
+    for (size_t i = 0; i < length; i++) data[i] = static_cast<uint8_t>(rng());
+}
+
+// 覆盖各后端的交织宽度（8/16 个分组一组，最多 64 个分组一批）附近的所有分组数
+static vector<size_t> block_counts(mt19937_64& rng, int rounds) {
+    vector<size_t> counts;
+    for (size_t n = 0; n <= 132; n++) counts.push_back(n);
+    for (int i = 0; i < rounds; i++) counts.push_back(rng() % 4096);
+    return counts;
+}
+
+static void diff_blocks(const SM4Key& ref, const SM4Key& key, const string& name,
+    mt19937_64& rng, int rounds)
+{
+    for (size_t n : block_counts(rng, rounds)) {
+        Buffers buf(n * 16, rng() % 16, rng);
+        ref.encryptBlocks(buf.in, buf.expect, n);
+        key.encryptBlocks(buf.in, buf.actual, n);
+        check(memcmp(buf.expect, buf.actual, n * 16) == 0, name + " encryptBlocks n=" + to_string(n));
+        ref.decryptBlocks(buf.in, buf.expect, n);
+        key.decryptBlocks(buf.in, buf.actual, n);
+        check(memcmp(buf.expect, buf.actual, n * 16) == 0, name + " decryptBlocks n=" + to_string(n));
+
+        // 原地处理
+        memcpy(buf.actual, buf.in, n * 16);
+        key.encryptBlocks(buf.actual, buf.actual, n);
+        ref.encryptBlocks(buf.in, buf.expect, n);
+        check(memcmp(buf.expect, buf.actual, n * 16) == 0, name + " encryptBlocks 原地 n=" + to_string(n));
+    }
+}
+
+static void diff_modes(const SM4Key& ref, const SM4Key& key, const SM4Key& refTweak, const SM4Key& tweak,
+    const string& name, mt19937_64& rng, int rounds)
+{
+    for (int r = 0; r < rounds; r++) {
+        size_t length = (r < 300) ? r : rng() % 20000;
+        unsigned threads = 1 + r % 3;
+        string tag = " len=" + to_string(length) + " threads=" + to_string(threads);
+        Buffers buf(length, rng() % 16, rng);
+
+        // CTR：计数器靠近 2^128 回绕
+        uint8_t counter[16];
+        random_bytes(rng, counter, 16);
+        if (r % 4 == 0) memset(counter + 8, 0xff, 8);
+        sm4_ctr_crypt(ref, counter, buf.in, length, buf.expect, 1);
+        sm4_ctr_crypt(key, counter, buf.in, length, buf.actual, threads);
+        check(memcmp(buf.expect, buf.actual, length) == 0, name + " CTR" + tag);
+
+        // CBC 解密（整分组）
+        size_t cbcLength = length - length % 16;
+        sm4_cbc_decrypt(ref, counter, buf.in, cbcLength, buf.expect, 1);
+        sm4_cbc_decrypt(key, counter, buf.in, cbcLength, buf.actual, threads);
+        check(memcmp(buf.expect, buf.actual, cbcLength) == 0, name + " CBC 解密" + tag);
+
+        // GCM：96 位与任意长度 IV，任意长度 AAD
+        uint8_t iv[40], aad[64], t1[16], t2[16];
+        size_t ivLength = (r % 5 == 0) ? 1 + rng() % 40 : 12;
+        size_t aadLength = rng() % 64;
+        random_bytes(rng, iv, sizeof(iv));
+        random_bytes(rng, aad, sizeof(aad));
+        sm4_gcm_encrypt(ref, buf.in, length, aad, aadLength, iv, ivLength, buf.expect, t1, 16, 1);
+        sm4_gcm_encrypt(key, buf.in, length, aad, aadLength, iv, ivLength, buf.actual, t2, 16, threads);
+        check(memcmp(buf.expect, buf.actual, length) == 0 && memcmp(t1, t2, 16) == 0, name + " GCM 加密" + tag);
+        check(sm4_gcm_decrypt(key, buf.expect, length, aad, aadLength, iv, ivLength, t1, 16, buf.actual, threads)
+            && memcmp(buf.actual, buf.in, length) == 0, name + " GCM 解密" + tag);
+
+        // XTS：一个数据单元，至少一个分组，非整分组时使用密文挪用
+        if (length >= 16) {
+            uint8_t tweakValue[16];
+            random_bytes(rng, tweakValue, 16);
+            sm4_xts_encrypt(ref, refTweak, tweakValue, buf.in, length, buf.expect);
+            sm4_xts_encrypt(key, tweak, tweakValue, buf.in, length, buf.actual);
+            check(memcmp(buf.expect, buf.actual, length) == 0, name + " XTS 加密" + tag);
+            sm4_xts_decrypt(key, tweak, tweakValue, buf.expect, length, buf.actual);
+            check(memcmp(buf.actual, buf.in, length) == 0, name + " XTS 解密" + tag);
+        }
+    }
+}
+
+// SM4 类的一次性接口（PKCS#7 填充、多分组与逐块两条路径）
+static void diff_sm4_class(const vector<uint8_t>& keyBytes, const BackendInfo& b, mt19937_64& rng, int rounds) {
+    string name = b.name;
+    uint8_t iv[16];
+    random_bytes(rng, iv, 16);
+    for (SM4::Mode mode : { SM4::ECB, SM4::CBC, SM4::CTR }) {
+        SM4 ref(keyBytes.data(), mode, SM4::REFERENCE);
+        SM4 sm4(keyBytes.data(), mode, b.backend);
+        ref.setIV(iv);
+        sm4.setIV(iv);
+        for (int r = 1; r <= rounds; r++) {
+            int length = (r < 200) ? r : 1 + static_cast<int>(rng() % 5000);
+            string tag = " mode=" + to_string(mode) + " len=" + to_string(length);
+            Buffers buf(length + 16, rng() % 16, rng);
+            int n1 = ref.encrypt(buf.in, length, buf.expect);
+            int n2 = sm4.encrypt_simd(buf.in, length, buf.actual);
+            check(n1 == n2 && memcmp(buf.expect, buf.actual, n1) == 0, name + " SM4::encrypt_simd" + tag);
+            n2 = sm4.encrypt(buf.in, length, buf.actual);
+            check(n1 == n2 && memcmp(buf.expect, buf.actual, n1) == 0, name + " SM4::encrypt" + tag);
+            if (mode != SM4::CTR && length % 16 == 0) continue;  // 整分组时没有填充，无法去除
+            int m = sm4.decrypt_simd(buf.expect, n1, buf.actual);
+            check(m == length && memcmp(buf.actual, buf.in, length) == 0, name + " SM4::decrypt_simd" + tag);
+        }
+    }
+}
+
+// 批量密钥扩展与多密钥内核：指定后端的向量内核与逐个密钥构造 REFERENCE 后端 SM4Key 的结果比较
+static void diff_expand_keys(const BackendInfo& b, mt19937_64& rng) {
+    for (size_t count = 1; count <= 40; count++) {
+        vector<uint8_t> keys(count * 16), in(count * 16), out(count * 16);
+        random_bytes(rng, keys.data(), keys.size());
+        random_bytes(rng, in.data(), in.size());
+        vector<uint32_t> rk(count * 32);
+        sm4_expand_keys(keys.data(), count, rk.data(), b.backend);
+        sm4_encrypt_lanes(rk.data(), count, in.data(), out.data(), b.backend);
+        bool ok = true;
+        for (size_t i = 0; i < count; i++) {
+            SM4Key ref(keys.data() + i * 16, SM4::REFERENCE);
+            uint8_t expect[16];
+            ref.encryptBlock(in.data() + i * 16, expect);
+            ok = ok && memcmp(expect, out.data() + i * 16, 16) == 0;
+        }
+        check(ok, string(b.name) + " sm4_expand_keys/sm4_encrypt_lanes count=" + to_string(count));
+    }
+}
+
+// 多缓冲区 CBC 加密：每个任务独立的密钥、IV 与长度（含空任务和原地处理），
+// 与 REFERENCE 后端的 SM4Context 逐个任务串行加密比较
+static void diff_cbc_multi(const BackendInfo& b, mt19937_64& rng, int rounds) {
+    for (int r = 0; r < rounds / 4 + 1; r++) {
+        size_t count = 1 + rng() % 40;
+        unsigned threads = 1 + r % 3;
+        vector<unique_ptr<SM4Key>> keys, refs;
+        vector<vector<uint8_t>> ivs(count), inputs(count), outputs(count), expects(count);
+        vector<SM4CbcJob> jobs(count);
+        for (size_t i = 0; i < count; i++) {
+            uint8_t keyBytes[16];
+            random_bytes(rng, keyBytes, 16);
+            keys.emplace_back(new SM4Key(keyBytes, b.backend));
+            refs.emplace_back(new SM4Key(keyBytes, SM4::REFERENCE));
+            size_t length = (i % 7 == 0) ? 0 : 16 * (rng() % (r % 2 == 0 ? 8 : 200));
+            ivs[i].resize(16);
+            random_bytes(rng, ivs[i].data(), 16);
+            inputs[i].resize(length);
+            random_bytes(rng, inputs[i].data(), length);
+            expects[i].resize(length);
+            SM4Context ctx(*refs[i], SM4::CBC, ivs[i].data());
+            ctx.encryptBlocks(inputs[i].data(), length, expects[i].data());
+            outputs[i] = (i % 3 == 0) ? inputs[i] : vector<uint8_t>(length);
+            const uint8_t* input = (i % 3 == 0) ? outputs[i].data() : inputs[i].data();
+            jobs[i] = SM4CbcJob{ keys[i].get(), ivs[i].data(), input, length, outputs[i].data() };
+        }
+        sm4_cbc_encrypt_multi(jobs.data(), count, threads);
+        bool ok = true;
+        for (size_t i = 0; i < count; i++) {
+            ok = ok && outputs[i] == expects[i];
+        }
+        check(ok, string(b.name) + " sm4_cbc_encrypt_multi count=" + to_string(count) + " threads=" + to_string(threads));
+    }
+}
+
+// 批量 GCM：与 REFERENCE 后端逐个报文的 sm4_gcm_encrypt 比较，解密时篡改部分标签
+static void diff_gcm_batch(const SM4Key& ref, const SM4Key& key, const string& name, mt19937_64& rng, int rounds) {
+    for (int r = 0; r < rounds / 4 + 1; r++) {
+        size_t count = 1 + rng() % 70;
+        unsigned threads = 1 + r % 3;
+        string tag = " count=" + to_string(count) + " threads=" + to_string(threads);
+        vector<vector<uint8_t>> ivs(count), aads(count), inputs(count), outputs(count), expects(count);
+        vector<array<uint8_t, 16>> tags(count), expectTags(count);
+        vector<SM4GcmPacket> packets(count);
+        for (size_t i = 0; i < count; i++) {
+            size_t length = (i % 5 == 4) ? rng() % 3000 : rng() % 100;
+            ivs[i].resize(i % 6 == 5 ? 1 + rng() % 40 : 12);
+            aads[i].resize(rng() % 40);
+            inputs[i].resize(length);
+            random_bytes(rng, ivs[i].data(), ivs[i].size());
+            random_bytes(rng, aads[i].data(), aads[i].size());
+            random_bytes(rng, inputs[i].data(), length);
+            expects[i].resize(length);
+            sm4_gcm_encrypt(ref, inputs[i].data(), length, aads[i].data(), aads[i].size(),
+                ivs[i].data(), ivs[i].size(), expects[i].data(), expectTags[i].data(), 16, 1);
+            outputs[i].assign(length, 0);
+            packets[i] = SM4GcmPacket{ ivs[i].data(), ivs[i].size(), aads[i].data(), aads[i].size(),
+                inputs[i].data(), length, outputs[i].data(), tags[i].data() };
+        }
+        sm4_gcm_seal_batch(key, packets.data(), count, threads);
+        bool ok = true;
+        for (size_t i = 0; i < count; i++) {
+            ok = ok && outputs[i] == expects[i] && tags[i] == expectTags[i];
+        }
+        check(ok, name + " sm4_gcm_seal_batch" + tag);
+
+        // 原地解密；每三个报文篡改一个标签，期望对应结果为 false 且输出清零
+        unique_ptr<bool[]> results(new bool[count]);
+        bool expectAll = true;
+        for (size_t i = 0; i < count; i++) {
+            if (i % 3 == 1) {
+                tags[i][rng() % 16] ^= 0x80;
+                expectAll = false;
+            }
+            packets[i].input = outputs[i].data();
+        }
+        bool all = sm4_gcm_open_batch(key, packets.data(), count, results.get(), threads);
+        ok = all == expectAll;
+        for (size_t i = 0; i < count; i++) {
+            bool tampered = i % 3 == 1;
+            vector<uint8_t> expect = tampered ? vector<uint8_t>(inputs[i].size(), 0) : inputs[i];
+            ok = ok && results[i] == !tampered && outputs[i] == expect;
+        }
+        check(ok, name + " sm4_gcm_open_batch" + tag);
+    }
+}
+
+// 按扇区的 XTS：与 REFERENCE 后端逐个扇区的 sm4_xts_encrypt（调整值为扇区号的 128 位小端表示）比较，
+// 扇区号跨过 2^64 时调整值向高 64 位进位
+static void diff_xts_sectors(const SM4Key& ref, const SM4Key& key, const SM4Key& refTweak, const SM4Key& tweak,
+    const string& name, mt19937_64& rng, int rounds)
+{
+    const size_t sizes[] = { 16, 17, 512, 4096 };
+    for (int r = 0; r < rounds / 4 + 1; r++) {
+        size_t sectorSize = (r % 5 == 4) ? 16 + rng() % 1000 : sizes[r % 4];
+        size_t count = rng() % 9;
+        uint64_t sector = (r % 3 == 0) ? ~uint64_t(0) - rng() % 8 : rng();
+        unsigned threads = 1 + r % 3;
+        size_t length = count * sectorSize;
+        string tag = " sectorSize=" + to_string(sectorSize) + " count=" + to_string(count)
+            + " threads=" + to_string(threads);
+        Buffers buf(length, rng() % 16, rng);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t number = sector + i;
+            uint8_t tweakValue[16] = { 0 };
+            for (int k = 0; k < 8; k++) tweakValue[k] = static_cast<uint8_t>(number >> (8 * k));
+            tweakValue[8] = number < sector ? 1 : 0;
+            sm4_xts_encrypt(ref, refTweak, tweakValue, buf.in + i * sectorSize, sectorSize,
+                buf.expect + i * sectorSize);
+        }
+        sm4_xts_encrypt_sectors(key, tweak, sector, sectorSize, buf.in, length, buf.actual, threads);
+        check(memcmp(buf.expect, buf.actual, length) == 0, name + " sm4_xts_encrypt_sectors" + tag);
+        sm4_xts_decrypt_sectors(key, tweak, sector, sectorSize, buf.expect, length, buf.actual, threads);
+        check(memcmp(buf.in, buf.actual, length) == 0, name + " sm4_xts_decrypt_sectors" + tag);
+    }
+}
+
+// 流式 GCM：AAD 与数据分成随机大小的块送入（部分原地处理），与 REFERENCE 后端的一次性接口比较
+static void diff_gcm_context(const SM4Key& ref, const SM4Key& key, const string& name, mt19937_64& rng, int rounds) {
+    // 把 [0, length) 切成随机大小的块，依次调用 fn(偏移, 长度)
+    auto chunks = [&rng](size_t length, size_t maxChunk, const function<void(size_t, size_t)>& fn) {
+        size_t done = 0;
+        do {
+            size_t n = min(length - done, static_cast<size_t>(rng() % (maxChunk + 1)));
+            fn(done, n);
+            done += n;
+        } while (done < length);
+    };
+
+    SM4GcmContext ctx(key);
+    for (int r = 0; r < rounds; r++) {
+        size_t length = (r < 100) ? r : rng() % 5000;
+        size_t aadLength = rng() % 80;
+        size_t maxChunk = (r % 2 == 0) ? 20 : 300;
+        string tag = " len=" + to_string(length) + " aad=" + to_string(aadLength);
+        Buffers buf(length, rng() % 16, rng);
+        uint8_t iv[40], aad[80], t1[16], t2[16];
+        size_t ivLength = (r % 4 == 3) ? 1 + rng() % 40 : 12;
+        random_bytes(rng, iv, sizeof(iv));
+        random_bytes(rng, aad, sizeof(aad));
+        sm4_gcm_encrypt(ref, buf.in, length, aad, aadLength, iv, ivLength, buf.expect, t1, 16, 1);
+
+        bool inPlace = r % 3 == 0;
+        if (inPlace) memcpy(buf.actual, buf.in, length);
+        const uint8_t* input = inPlace ? buf.actual : buf.in;
+        ctx.init(iv, ivLength, true);
+        chunks(aadLength, maxChunk, [&](size_t offset, size_t n) { ctx.setAAD(aad + offset, n); });
+        chunks(length, maxChunk, [&](size_t offset, size_t n) { ctx.update(input + offset, n, buf.actual + offset); });
+        ctx.finish(t2);
+        check(memcmp(buf.expect, buf.actual, length) == 0 && memcmp(t1, t2, 16) == 0,
+            name + " SM4GcmContext 加密" + tag);
+
+        ctx.init(iv, ivLength, false);
+        chunks(aadLength, maxChunk, [&](size_t offset, size_t n) { ctx.setAAD(aad + offset, n); });
+        chunks(length, maxChunk, [&](size_t offset, size_t n) { ctx.update(buf.expect + offset, n, buf.actual + offset); });
+        t1[r % 16] ^= (r % 5 == 0) ? 0x01 : 0x00;
+        bool ok = ctx.verify(t1);
+        check(ok == (r % 5 != 0) && memcmp(buf.in, buf.actual, length) == 0, name + " SM4GcmContext 解密" + tag);
+    }
+}
+
+// GHASH 的各种实现与逐位乘法比较
+static void diff_ghash(mt19937_64& rng, int rounds) {
+    const GHashKey::Backend backends[] = { GHashKey::TABLE4, GHashKey::TABLE8, GHashKey::CLMUL, GHashKey::VPCLMUL };
+    const char* names[] = { "table4", "table8", "clmul", "vpclmul" };
+    uint8_t H[16];
+    random_bytes(rng, H, 16);
+    GHashKey ref(H, GHashKey::BITWISE);
+
+    for (int i = 0; i < 4; i++) {
+        unique_ptr<GHashKey> key;
+        try {
+            key.reset(new GHashKey(H, backends[i]));
+        }
+        catch (const runtime_error&) {
+            cout << "跳过 GHASH 实现 " << names[i] << "（当前 CPU 不支持）" << endl;
+            continue;
+        }
+        for (int r = 0; r < rounds; r++) {
+            size_t length = (r < 300) ? r : rng() % 10000;
+            vector<uint8_t> data(length);
+            random_bytes(rng, data.data(), length);
+            uint8_t x1[16], x2[16];
+            random_bytes(rng, x1, 16);
+            memcpy(x2, x1, 16);
+            ref.update(x1, data.data(), length);
+            key->update(x2, data.data(), length);
+            check(memcmp(x1, x2, 16) == 0, string("GHASH ") + names[i] + " len=" + to_string(length));
+        }
+        uint8_t p1[16], p2[16];
+        ref.power(1000003, p1);
+        key->power(1000003, p2);
+        check(memcmp(p1, p2, 16) == 0, string("GHASH ") + names[i] + " power");
+    }
+}
+
+//-------------批量加解密引擎--------------
+
+// 一个引擎作业及其按一次性接口算出的期望结果
+struct EngineCase {
+    SM4Job job;
+    vector<uint8_t> iv, aad, input, output, tag, expect, expectTag;
+    bool expectOk;
+    bool useCallback;
+    future<bool> result;
+    int callbackResult;
+};
+
+static void test_engine(uint64_t seed) {
+    cout << "SM4Engine" << endl;
+    mt19937_64 rng(seed);
+    uint8_t keyBytes[16];
+    random_bytes(rng, keyBytes, 16);
+    SM4Key key(keyBytes);
+
+    // 切分粒度取 4KB，几 KB 到几十 KB 的作业就会切成多段并被其他线程窃取
+    const size_t splitBytes = 4096;
+    SM4Engine engine(3, splitBytes);
+
+    // 先是随机混合的操作和长度，再是连续的同类小作业（合批）
+    vector<SM4Job::Op> ops;
+    for (int i = 0; i < 140; i++) ops.push_back(static_cast<SM4Job::Op>(rng() % 7));
+    for (SM4Job::Op op : { SM4Job::GCM_SEAL, SM4Job::GCM_OPEN, SM4Job::CTR }) {
+        for (int i = 0; i < 40; i++) ops.push_back(op);
+    }
+
+    vector<unique_ptr<EngineCase>> cases;
+    for (size_t i = 0; i < ops.size(); i++) {
+        unique_ptr<EngineCase> c(new EngineCase);
+        SM4Job::Op op = ops[i];
+        size_t length;
+        if (i >= 140 || i % 3 == 0) length = rng() % 1024;
+        else if (i % 3 == 1) length = rng() % splitBytes;
+        else length = splitBytes + rng() % (10 * splitBytes);
+        if (op == SM4Job::ECB_ENCRYPT || op == SM4Job::ECB_DECRYPT ||
+            op == SM4Job::CBC_ENCRYPT || op == SM4Job::CBC_DECRYPT) {
+            length -= length % 16;
+        }
+        bool gcm = op == SM4Job::GCM_SEAL || op == SM4Job::GCM_OPEN;
+
+        c->iv.resize(gcm && i % 5 == 0 ? 1 + rng() % 32 : gcm ? 12 : 16);
+        random_bytes(rng, c->iv.data(), c->iv.size());
+        // CTR：低 32 位接近回绕，切分后各段的计数器要向高位进位
+        if (op == SM4Job::CTR && i % 2 == 0) memset(c->iv.data() + 12, 0xff, 4);
+        c->aad.resize(gcm ? rng() % 48 : 0);
+        random_bytes(rng, c->aad.data(), c->aad.size());
+        c->input.resize(length);
+        random_bytes(rng, c->input.data(), length);
+        c->output.assign(length + 1, 0);
+        c->expect.resize(length + 1);
+        c->tag.assign(16, 0);
+        c->expectTag.assign(16, 0);
+        c->expectOk = true;
+
+        switch (op) {
+        case SM4Job::ECB_ENCRYPT:
+            key.encryptBlocks(c->input.data(), c->expect.data(), length / 16);
+            break;
+        case SM4Job::ECB_DECRYPT:
+            key.decryptBlocks(c->input.data(), c->expect.data(), length / 16);
+            break;
+        case SM4Job::CBC_ENCRYPT: {
+            SM4Context ctx(key, SM4::CBC, c->iv.data());
+            ctx.encryptBlocks(c->input.data(), length, c->expect.data());
+            break;
+        }
+        case SM4Job::CBC_DECRYPT:
+            sm4_cbc_decrypt(key, c->iv.data(), c->input.data(), length, c->expect.data(), 1);
+            break;
+        case SM4Job::CTR:
+            sm4_ctr_crypt(key, c->iv.data(), c->input.data(), length, c->expect.data(), 1);
+            break;
+        case SM4Job::GCM_SEAL:
+            sm4_gcm_encrypt(key, c->input.data(), length, c->aad.data(), c->aad.size(),
+                c->iv.data(), c->iv.size(), c->expect.data(), c->expectTag.data(), 16, 1);
+            break;
+        case SM4Job::GCM_OPEN: {
+            // 输入为一次性接口加密的密文；每四个作业篡改一个标签，期望认证失败且输出清零
+            vector<uint8_t> plain = c->input;
+            sm4_gcm_encrypt(key, plain.data(), length, c->aad.data(), c->aad.size(),
+                c->iv.data(), c->iv.size(), c->input.data(), c->tag.data(), 16, 1);
+            c->expect = plain;
+            c->expect.push_back(0);
+            if (i % 4 == 0) {
+                c->tag[rng() % 16] ^= 0x01;
+                c->expectOk = false;
+                fill(c->expect.begin(), c->expect.begin() + length, 0);
+                memset(c->output.data(), 0xaa, length);
+            }
+            break;
+        }
+        }
+
+        // 每三个作业有一个原地处理
+        const uint8_t* input = c->input.data();
+        if (i % 3 == 2) {
+            memcpy(c->output.data(), c->input.data(), length);
+            input = c->output.data();
+        }
+        c->job = SM4Job{ op, &key, c->iv.data(), c->iv.size(), c->aad.data(), c->aad.size(),
+            input, length, c->output.data(), c->tag.data() };
+        c->useCallback = i % 2 == 1;
+        c->callbackResult = -1;
+        cases.push_back(std::move(c));
+    }
+
+    for (auto& c : cases) {
+        if (c->useCallback) {
+            EngineCase* p = c.get();
+            engine.submit(c->job, [p](bool ok) { p->callbackResult = ok ? 1 : 0; });
+        }
+        else {
+            c->result = engine.submit(c->job);
+        }
+    }
+    engine.wait();
+
+    for (size_t i = 0; i < cases.size(); i++) {
+        EngineCase& c = *cases[i];
+        bool ok = c.useCallback ? c.callbackResult == (c.expectOk ? 1 : 0) : c.result.get() == c.expectOk;
+        size_t length = c.job.length;
+        ok = ok && memcmp(c.output.data(), c.expect.data(), length) == 0 && c.output[length] == 0;
+        if (c.job.op == SM4Job::GCM_SEAL) ok = ok && c.tag == c.expectTag;
+        check(ok, "SM4Engine 作业 " + to_string(i) + " op=" + to_string(c.job.op) + " len=" + to_string(length)
+            + (c.useCallback ? " 回调" : " future"));
+    }
+
+    // 参数无效时 submit 立即抛出
+    bool thrown = false;
+    try {
+        SM4Job bad = { SM4Job::ECB_ENCRYPT, &key, nullptr, 0, nullptr, 0, keyBytes, 15, keyBytes, nullptr };
+        engine.submit(bad);
+    }
+    catch (const invalid_argument&) {
+        thrown = true;
+    }
+    check(thrown, "SM4Engine 无效参数");
+
+    // 回调抛出的异常被丢弃：工作线程继续运行，wait() 仍能返回
+    uint8_t block[16] = { 0 };
+    vector<uint8_t> out(16 * (engine.size() + 2));
+    for (unsigned i = 0; i <= engine.size(); i++) {
+        SM4Job job = { SM4Job::ECB_ENCRYPT, &key, nullptr, 0, nullptr, 0, block, 16, out.data() + 16 * i, nullptr };
+        engine.submit(job, [](bool) { throw runtime_error("callback"); });
+    }
+    engine.wait();
+    SM4Job job = { SM4Job::ECB_ENCRYPT, &key, nullptr, 0, nullptr, 0, block, 16, out.data() + out.size() - 16, nullptr };
+    check(engine.submit(job).get(), "SM4Engine 回调抛出异常后继续工作");
+}
+
+//-------------分块加密文件--------------
+
+// 在一份正确的加密文件上做一处修改，整体解密与覆盖被修改块的区间读取都应失败
+static void file_rejects(const SM4Key& key, vector<uint8_t> file, size_t plainSize, const string& name) {
+    vector<uint8_t> out(plainSize + 1, 0xaa);
+    check(!sm4_file_decrypt(key, file.data(), file.size(), out.data(), 1), "sm4_file_decrypt 拒绝" + name);
+    bool read = plainSize > 0 && sm4_file_read(key, file.data(), file.size(), 0, plainSize, out.data());
+    check(!read, "sm4_file_read 拒绝" + name);
+}
+
+static void test_file(uint64_t seed) {
+    cout << "分块加密文件" << endl;
+    mt19937_64 rng(seed);
+    uint8_t keyBytes[16];
+    random_bytes(rng, keyBytes, 16);
+    SM4Key key(keyBytes);
+
+    // 往返：空文件、块边界两侧的长度与随机长度
+    for (uint32_t chunkSize : { 16u, 64u, 4096u }) {
+        vector<size_t> sizes = { 0, 1, 15, 16, 17, chunkSize - 1, chunkSize, chunkSize + 1,
+            3 * size_t(chunkSize), 3 * size_t(chunkSize) + 5 };
+        for (int i = 0; i < 4; i++) sizes.push_back(rng() % (5 * size_t(chunkSize)));
+        for (size_t n : sizes) {
+            string tag = " chunk=" + to_string(chunkSize) + " len=" + to_string(n);
+            vector<uint8_t> plain(n), out(n + 1, 0);
+            random_bytes(rng, plain.data(), n);
+            SM4FileHeader header;
+            header.chunkSize = chunkSize;
+            header.plainSize = n;
+            random_bytes(rng, header.nonce, 12);
+            vector<uint8_t> file(static_cast<size_t>(sm4_file_size(n, chunkSize)));
+            sm4_file_encrypt(key, header, plain.data(), file.data(), 1 + n % 3);
+
+            SM4FileHeader parsed;
+            check(sm4_file_parse_header(file.data(), file.size(), parsed) && parsed.chunkSize == chunkSize
+                && parsed.plainSize == n && memcmp(parsed.nonce, header.nonce, 12) == 0, "sm4_file_parse_header" + tag);
+            check(sm4_file_decrypt(key, file.data(), file.size(), out.data(), 1 + n % 2)
+                && memcmp(out.data(), plain.data(), n) == 0 && out[n] == 0, "sm4_file 往返" + tag);
+        }
+    }
+
+    // 区间读取与篡改：64 字节的块，最后一块不满
+    const uint32_t chunkSize = 64;
+    const size_t n = 5 * chunkSize + 40;
+    vector<uint8_t> plain(n);
+    random_bytes(rng, plain.data(), n);
+    SM4FileHeader header;
+    header.chunkSize = chunkSize;
+    header.plainSize = n;
+    random_bytes(rng, header.nonce, 12);
+    vector<uint8_t> file(static_cast<size_t>(sm4_file_size(n, chunkSize)));
+    sm4_file_encrypt(key, header, plain.data(), file.data(), 1);
+
+    // 整块、跨块、从分组中间开始、结束在块末尾以及随机区间
+    vector<pair<size_t, size_t>> ranges = { { 0, n }, { 0, 1 }, { 5, 11 }, { 60, 8 }, { 64, 64 }, { 70, 200 },
+        { 127, 2 }, { 100, 0 }, { n - 1, 1 }, { n - 40, 40 }, { 3 * 64 + 9, 64 } };
+    for (int i = 0; i < 40; i++) {
+        size_t offset = rng() % (n + 1);
+        ranges.push_back({ offset, rng() % (n - offset + 1) });
+    }
+    for (const auto& r : ranges) {
+        vector<uint8_t> out(r.second + 1, 0);
+        check(sm4_file_read(key, file.data(), file.size(), r.first, r.second, out.data())
+            && memcmp(out.data(), plain.data() + r.first, r.second) == 0 && out[r.second] == 0,
+            "sm4_file_read offset=" + to_string(r.first) + " count=" + to_string(r.second));
+    }
+    uint8_t scratch[16];
+    check(!sm4_file_read(key, file.data(), file.size(), n - 3, 4, scratch), "sm4_file_read 区间越界");
+
+    // 文件头的每个字节（魔数、版本、块大小、长度、nonce、保留字段）
+    for (size_t i = 0; i < SM4_FILE_HEADER_SIZE; i++) {
+        vector<uint8_t> bad = file;
+        bad[i] ^= 0x01;
+        file_rejects(key, bad, n, "文件头第 " + to_string(i) + " 字节");
+    }
+
+    // 交换两个等长的块（含标签）、把块移到另一位置、截断最后一块、去掉一个字节
+    size_t stride = chunkSize + 16;
+    vector<uint8_t> swapped = file;
+    swap_ranges(swapped.begin() + SM4_FILE_HEADER_SIZE, swapped.begin() + SM4_FILE_HEADER_SIZE + stride,
+        swapped.begin() + SM4_FILE_HEADER_SIZE + stride);
+    file_rejects(key, swapped, n, "交换块 0 与块 1");
+    vector<uint8_t> moved = file;
+    copy(file.begin() + SM4_FILE_HEADER_SIZE + 3 * stride, file.begin() + SM4_FILE_HEADER_SIZE + 4 * stride,
+        moved.begin() + SM4_FILE_HEADER_SIZE + stride);
+    file_rejects(key, moved, n, "块 3 覆盖块 1");
+    file_rejects(key, vector<uint8_t>(file.begin(), file.begin() + SM4_FILE_HEADER_SIZE + 5 * stride), n, "截断最后一块");
+    file_rejects(key, vector<uint8_t>(file.begin(), file.end() - 1), n, "截断一个字节");
+
+    // 修改块 2 的标签：覆盖块 2 的区间读取失败且不写输出，其他块仍可读取
+    vector<uint8_t> badTag = file;
+    badTag[SM4_FILE_HEADER_SIZE + 2 * stride + chunkSize + 7] ^= 0x40;
+    file_rejects(key, badTag, n, "修改标签");
+    vector<uint8_t> out(32, 0x5c);
+    check(!sm4_file_read(key, badTag.data(), badTag.size(), 2 * 64 + 3, 20, out.data())
+        && all_of(out.begin(), out.end(), [](uint8_t b) { return b == 0x5c; }), "sm4_file_read 标签错误时不写输出");
+    check(sm4_file_read(key, badTag.data(), badTag.size(), 64 + 3, 20, out.data())
+        && memcmp(out.data(), plain.data() + 64 + 3, 20) == 0, "sm4_file_read 其他块不受影响");
+
+    // 错误的密钥
+    uint8_t wrongBytes[16];
+    memcpy(wrongBytes, keyBytes, 16);
+    wrongBytes[0] ^= 0x80;
+    file_rejects(SM4Key(wrongBytes), file, n, "错误的密钥");
+}
+
+static void test_differential(const vector<BackendInfo>& backends, uint64_t seed, int rounds) {
+    cout << "差分测试（seed=" << seed << "）" << endl;
+    mt19937_64 rng(seed);
+    vector<uint8_t> keyBytes(16), tweakBytes(16);
+    random_bytes(rng, keyBytes.data(), 16);
+    random_bytes(rng, tweakBytes.data(), 16);
+    SM4Key ref(keyBytes.data(), SM4::REFERENCE);
+    SM4Key refTweak(tweakBytes.data(), SM4::REFERENCE);
+
+    for (const BackendInfo& b : backends) {
+        if (b.backend == SM4::REFERENCE) continue;
+        SM4Key key(keyBytes.data(), b.backend);
+        SM4Key tweak(tweakBytes.data(), b.backend);
+        int before = failures;
+        diff_blocks(ref, key, b.name, rng, rounds);
+        diff_modes(ref, key, refTweak, tweak, b.name, rng, rounds);
+        diff_sm4_class(keyBytes, b, rng, rounds);
+        diff_expand_keys(b, rng);
+        diff_cbc_multi(b, rng, rounds);
+        diff_gcm_batch(ref, key, b.name, rng, rounds);
+        diff_xts_sectors(ref, key, refTweak, tweak, b.name, rng, rounds);
+        diff_gcm_context(ref, key, b.name, rng, rounds);
+        cout << "  " << b.name << (failures == before ? " 通过" : " 失败") << endl;
+    }
+    diff_ghash(rng, rounds);
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        uint64_t seed = random_device()();
+        int rounds = 400;
+        bool quick = false;
+        for (int i = 1; i < argc; i++) {
+            string arg = argv[i];
+            if (arg == "--seed" && i + 1 < argc) seed = stoull(argv[++i]);
+            else if (arg == "--rounds" && i + 1 < argc) rounds = stoi(argv[++i]);
+            else if (arg == "--quick") quick = true;
+            else throw runtime_error("未知的选项 " + arg);
+        }
+        if (quick) rounds = min(rounds, 40);
+
+        vector<BackendInfo> backends = available_backends();
+        test_gbt32907(backends, quick);
+        test_modes(backends);
+        test_gcm_rfc8998(backends);
+        test_drbg();
+        test_engine(seed);
+        test_file(seed);
+        test_differential(backends, seed, rounds);
+
+        cout << checks << " 项检查，" << failures << " 项失败" << endl;
+        return failures == 0 ? 0 : 1;
+    }
+    catch (const exception& e) {
+        cerr << "错误: " << e.what() << endl;
+        return 1;
+    }
+}
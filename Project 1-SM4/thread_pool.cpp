@@ -0,0 +1,110 @@
+#include "thread_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+// һ parallelFor Ĺ״̬Ŷеĸڵ÷زУ
+// ͨ shared_ptr Уõߵջ
+struct ThreadPool::Batch {
+    std::function<void(size_t)> fn;
+    size_t tasks;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::exception_ptr error;
+
+    // ȡһִУֱȫ
+    void run() {
+        for (;;) {
+            size_t i = next.fetch_add(1);
+            if (i >= tasks) return;
+            try {
+                fn(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error) error = std::current_exception();
+            }
+            if (done.fetch_add(1) + 1 == tasks) {
+                std::lock_guard<std::mutex> lock(mutex);
+                cv.notify_all();
+            }
+        }
+    }
+};
+
+ThreadPool::ThreadPool(unsigned threads) : stopping(false) {
+    if (threads == 0) {
+        threads = std::thread::hardware_concurrency();
+        if (threads == 0) threads = 1;
+    }
+    for (unsigned i = 0; i < threads; i++) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (std::thread& t : workers) {
+        t.join();
+    }
+}
+
+void ThreadPool::workerLoop() {
+    for (;;) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (stopping && jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void ThreadPool::post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_one();
+}
+
+void ThreadPool::parallelFor(size_t tasks, const std::function<void(size_t)>& fn) {
+    if (tasks == 0) return;
+    if (tasks == 1 || workers.empty()) {
+        for (size_t i = 0; i < tasks; i++) fn(i);
+        return;
+    }
+
+    std::shared_ptr<Batch> batch = std::make_shared<Batch>();
+    batch->fn = fn;
+    batch->tasks = tasks;
+    batch->next = 0;
+    batch->done = 0;
+
+    // ߳ԼҲִֻٻ tasks - 1 
+    size_t helpers = std::min(tasks - 1, workers.size());
+    for (size_t i = 0; i < helpers; i++) {
+        post([batch] { batch->run(); });
+    }
+    batch->run();
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->cv.wait(lock, [&] { return batch->done.load() == tasks; });
+    if (batch->error) {
+        std::rethrow_exception(batch->error);
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,50 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <thread>
+#include <vector>
+
+// ̶СĹ̳߳أڰѴ󻺳зָ̲߳мӽ
+class ThreadPool {
+public:
+    // threads Ϊ 0 ʱʹ CPU Ӳ߳
+    explicit ThreadPool(unsigned threads = 0);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // ߳
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // ִ fn(0) .. fn(tasks - 1)ȫɺ󷵻
+    // ߳ҲִУڹ߳Ƕ׵ò
+    // ׳ĵһ쳣ڵ߳׳
+    void parallelFor(size_t tasks, const std::function<void(size_t)>& fn);
+
+    // ڹ̳߳
+    static ThreadPool& shared();
+
+private:
+    struct Batch;
+
+    // ߳ѭ
+    void workerLoop();
+
+    // Ͷһ
+    void post(std::function<void()> job);
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+};
+
+#endif // THREAD_POOL_H
@@ -2,6 +2,7 @@
 #include <iostream>
 #include <string>
 #include <cstring>
+#include <cstdlib>
 #include <vector>
 #include <algorithm>
 #include <iomanip>
@@ -134,39 +135,133 @@ void compress(uint32 V[8], const uint32 B[16]) {
     V[7] ^= H;
 }
 
-// 计算SM3哈希值
-string sm3(const vector<uint8_t>& msg) {
-    // 消息填充
-    vector<uint8_t> padded = padding(msg);
-    size_t block_num = padded.size() / 64;  // 每个块64字节 512 bit
+// 读取大端序32位字：已知为小端的平台（GCC/Clang 按 __BYTE_ORDER__ 判断，MSVC 支持的平台均为小端）
+// 整字读取后字节反转，其他平台逐字节移位
+inline uint32 load_be32(const uint8_t* p) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint32 x;
+    memcpy(&x, p, 4);
+    return __builtin_bswap32(x);
+#elif defined(_MSC_VER)
+    uint32 x;
+    memcpy(&x, p, 4);
+    return _byteswap_ulong(x);
+#else
+    return ((uint32)p[0] << 24) | ((uint32)p[1] << 16) | ((uint32)p[2] << 8) | (uint32)p[3];
+#endif
+}
 
-    // 初始化哈希值
-    uint32 V[8];
-    memcpy(V, IV, 8 * sizeof(uint32));
-
-    // 处理每个消息块
-    for (size_t i = 0; i < block_num; ++i) {
-        // 将64字节转换为16个32位整数（大端序）
-        uint32 B[16];
-        for (int j = 0; j < 16; ++j) {
-            B[j] = (padded[i * 64 + j * 4] << 24) |
-                (padded[i * 64 + j * 4 + 1] << 16) |
-                (padded[i * 64 + j * 4 + 2] << 8) |
-                padded[i * 64 + j * 4 + 3];
+// 写入大端序32位字
+inline void store_be32(uint8_t* p, uint32 x) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    x = __builtin_bswap32(x);
+    memcpy(p, &x, 4);
+#elif defined(_MSC_VER)
+    x = _byteswap_ulong(x);
+    memcpy(p, &x, 4);
+#else
+    p[0] = (uint8_t)(x >> 24);
+    p[1] = (uint8_t)(x >> 16);
+    p[2] = (uint8_t)(x >> 8);
+    p[3] = (uint8_t)x;
+#endif
+}
+
+// 压缩一个64字节的消息块，直接从给定地址读取
+inline void compress_block(uint32 V[8], const uint8_t* block) {
+    uint32 B[16];
+    for (int j = 0; j < 16; ++j) {
+        B[j] = load_be32(block + j * 4);
+    }
+    compress(V, B);
+}
+
+// 流式SM3上下文
+// update 直接压缩调用者缓冲区中的完整块，只缓存不足一块的尾部（最多63字节），
+// final 时才在缓存上填充，内存占用与消息长度无关，每个字节只读取一次
+class SM3Context {
+public:
+    SM3Context() { init(); }
+
+    // 从标准初始向量开始
+    void init() { init(IV, 0); }
+
+    // 从给定的中间杂凑值继续，length_bits 为之前已压缩的消息长度（比特），计入最终填充的长度（用于长度扩展攻击）
+    void init(const uint32 iv[8], uint64_t length_bits) {
+        memcpy(V, iv, 8 * sizeof(uint32));
+        buffered = 0;
+        total_bits = length_bits;
+    }
+
+    void update(const uint8_t* data, size_t len) {
+        // 空输入（data 可能为 nullptr）不做任何处理，避免以空指针调用 memcpy
+        if (len == 0) return;
+        total_bits += (uint64_t)len * 8;
+
+        // 先补齐上次留下的部分块
+        if (buffered > 0) {
+            size_t n = min(len, (size_t)64 - buffered);
+            memcpy(buffer + buffered, data, n);
+            buffered += n;
+            data += n;
+            len -= n;
+            if (buffered < 64) return;
+            compress_block(V, buffer);
+            buffered = 0;
+        }
+
+        // 完整块直接从输入压缩
+        for (; len >= 64; data += 64, len -= 64) {
+            compress_block(V, data);
         }
 
-        // 压缩函数
-        compress(V, B);
+        memcpy(buffer, data, len);
+        buffered = len;
     }
 
-    // 将哈希值转换为十六进制字符串
-    char hex[65];
-    for (int i = 0; i < 8; ++i) {
-        sprintf(hex + i * 8, "%08x", V[i]);
+    // 填充并输出32字节杂凑值，之后需要重新 init
+    void final(uint8_t digest[32]) {
+        // 填充1，再填充0使得长度对512取余448，最后是64位大端序的消息长度
+        buffer[buffered++] = 0x80;
+        if (buffered > 56) {
+            memset(buffer + buffered, 0, 64 - buffered);
+            compress_block(V, buffer);
+            buffered = 0;
+        }
+        memset(buffer + buffered, 0, 56 - buffered);
+        store_be32(buffer + 56, (uint32)(total_bits >> 32));
+        store_be32(buffer + 60, (uint32)total_bits);
+        compress_block(V, buffer);
+
+        for (int i = 0; i < 8; ++i) {
+            store_be32(digest + i * 4, V[i]);
+        }
+    }
+
+    // 填充并输出十六进制字符串
+    string final_hex() {
+        uint8_t digest[32];
+        final(digest);
+        char hex[65];
+        for (int i = 0; i < 32; ++i) {
+            sprintf(hex + i * 2, "%02x", digest[i]);
+        }
+        hex[64] = '\0';
+        return string(hex);
     }
-    hex[64] = '\0';
 
-    return string(hex);
+private:
+    uint32 V[8];
+    uint8_t buffer[64];
+    size_t buffered;
+    uint64_t total_bits;
+};
+
+// 计算SM3哈希值
+string sm3(const vector<uint8_t>& msg) {
+    SM3Context ctx;
+    ctx.update(msg.data(), msg.size());
+    return ctx.final_hex();
 }
 
 // 辅助函数：字符串转字节数组
@@ -196,53 +291,11 @@ vector<uint8_t> hex_to_bytes(const string& hex) {
 
 // 使用自定义IV计算SM3（用于长度扩展攻击）
 string sm3_with_custom_iv(const vector<uint8_t>& msg, const uint32 custom_IV[8], uint64_t original_length_bits) {
-    vector<uint8_t> padded = msg;
-
-    // 计算总长度（原始消息 + 新消息）
-    uint64_t total_bits = original_length_bits + msg.size() * 8;
-
-    // 添加填充位
-    padded.push_back(0x80);
-
-    // 计算需要填充的0的数量
-    size_t current_bits = total_bits + 8; // +8 for the 0x80 byte
-    size_t pad_bits = (448 - current_bits % 512 + 512) % 512;
-
-    for (size_t i = 0; i < pad_bits / 8; ++i) {
-        padded.push_back(0x00);
-    }
-
-    // 添加总长度（64位大端序）
-    for (int i = 7; i >= 0; --i) {
-        padded.push_back((total_bits >> (i * 8)) & 0xFF);
-    }
-
-    size_t block_num = padded.size() / 64;
-
-    // 使用自定义IV
-    uint32 V[8];
-    memcpy(V, custom_IV, 8 * sizeof(uint32));
-
-    // 处理每个消息块
-    for (size_t i = 0; i < block_num; ++i) {
-        uint32 B[16];
-        for (int j = 0; j < 16; ++j) {
-            B[j] = (padded[i * 64 + j * 4] << 24) |
-                (padded[i * 64 + j * 4 + 1] << 16) |
-                (padded[i * 64 + j * 4 + 2] << 8) |
-                padded[i * 64 + j * 4 + 3];
-        }
-        compress(V, B);
-    }
-
-    // 转换为十六进制字符串
-    char hex[65];
-    for (int i = 0; i < 8; ++i) {
-        sprintf(hex + i * 8, "%08x", V[i]);
-    }
-    hex[64] = '\0';
-
-    return string(hex);
+    // 从原始哈希值继续，总长度为原始消息（含填充）加新消息
+    SM3Context ctx;
+    ctx.init(custom_IV, original_length_bits);
+    ctx.update(msg.data(), msg.size());
+    return ctx.final_hex();
 }
 
 // 辅助函数：打印字节数组的十六进制表示
@@ -329,6 +382,24 @@ int main() {
         cout << "长度扩展攻击失败!" << endl;
     }
 
+    // 4. 流式接口测试：标准示例2（"abcd"重复16次）按不同分段输入，结果应与一次性计算相同
+    cout << endl << "4. 流式接口测试:" << endl;
+    string example2;
+    for (int i = 0; i < 16; ++i) {
+        example2 += "abcd";
+    }
+    vector<uint8_t> example2_bytes = str_to_bytes(example2);
+    bool stream_ok = sm3(example2_bytes) == "debe9ff92275b8a138604889c18e5a4d6fdb70e5387e5765293dcba39c0c5732";
+    const size_t chunk_sizes[] = { 1, 3, 7, 63, 64, 65 };
+    for (size_t chunk : chunk_sizes) {
+        SM3Context ctx;
+        for (size_t i = 0; i < full_message.size(); i += chunk) {
+            ctx.update(full_message.data() + i, min(chunk, full_message.size() - i));
+        }
+        stream_ok = stream_ok && ctx.final_hex() == correct_hash;
+    }
+    cout << (stream_ok ? "测试通过: 分段计算结果一致" : "测试失败: 分段计算结果不一致") << endl;
+
     // 展示完整的攻击消息内容
     cout << endl << "5. 完整扩展消息内容:" << endl;
     print_hex(full_message, "完整消息 (十六进制)");